@@ -6,22 +6,35 @@
 /**
  * The abstract matrix multiplier, only supplying a method for the
  * multiplication.
+ * The inputs are matrices of TIn, the products are summed in TAcc and the
+ * result is stored in a matrix of TOut, so that narrow inputs (int8_t,
+ * BFloat16, ...) can use a wider accumulator. By default all three are the same.
  */
-template<class T>
+template<class TIn, class TAcc = TIn, class TOut = TAcc>
 class AbstractMatrixMultiplier
 {
 public:
     /**
      * C = A * B
      */
-    virtual void multiply(const SquareMatrix<T>& A, const SquareMatrix<T>& B, SquareMatrix<T>& C) = 0;
+    virtual void multiply(const SquareMatrix<TIn>& A, const SquareMatrix<TIn>& B, SquareMatrix<TOut>& C) = 0;
 
     //! Empty virtual destructor, needed for correct polymorphism
     virtual ~AbstractMatrixMultiplier() = default;
 
     static auto getElementType()
     {
-        return T{};
+        return TIn{};
+    }
+
+    static auto getAccumulatorType()
+    {
+        return TAcc{};
+    }
+
+    static auto getOutputType()
+    {
+        return TOut{};
     }
 };
 
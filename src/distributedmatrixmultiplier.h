@@ -0,0 +1,564 @@
+#ifndef DISTRIBUTEDMATRIXMULTIPLIER_H
+#define DISTRIBUTEDMATRIXMULTIPLIER_H
+
+#include <algorithm>
+#include <cerrno>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+#include <dirent.h>
+#include <sys/socket.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <pcosynchro/pcoconditionvariable.h>
+#include <pcosynchro/pcomutex.h>
+#include <pcosynchro/pcothread.h>
+
+#include "abstractmatrixmultiplier.h"
+#include "matrix.h"
+#include "threadedmatrixmultiplier.h"
+
+/**
+ * A multiplier splitting the product over gridSize x gridSize worker processes of
+ * the local machine, with the SUMMA algorithm.
+ *
+ * The matrices are cut in gridSize x gridSize blocks, process (r, c) owning the
+ * blocks (r, c) of A, B and C. At step k, the owner of A(r, k) sends it to the
+ * processes of row r and the owner of B(k, c) to those of column c, then every
+ * process adds A(r, k) * B(k, c) to its block of C: the grid shares out the (i, j)
+ * blocks of the decomposition and goes through k in lockstep. Each process computes
+ * its block products with a ThreadedMatrixMultiplier of nbThreadsPerProcess threads,
+ * on copies of its blocks padded with zeros to a multiple of the sub-blocks of that
+ * multiplier, so that any block size is cut in sub-blocks of about 128.
+ *
+ * Blocks travel over Unix domain sockets: one pair between the helper process and
+ * each worker, and one pair between any two workers of the same row or column. In
+ * a worker, a communication thread receives the panels of the next steps while the
+ * multiplier computes the current one, at most nbPanelBuffers steps ahead.
+ *
+ * Workers allocate and start threads, which is only safe in a child of a single
+ * threaded process. The constructor therefore forks a helper process, which stays
+ * single threaded and forks the grid for each multiply(), the operands and the
+ * result going through a socket. Construct the multiplier before starting threads
+ * (or while none holds a lock): it is then usable from any thread.
+ *
+ * T must be trivially copyable, blocks being sent as raw bytes.
+ */
+template<class T>
+class DistributedMatrixMultiplier : public AbstractMatrixMultiplier<T>
+{
+    static_assert(std::is_trivially_copyable<T>::value, "Blocks are sent as raw bytes");
+
+public:
+    //! Number of steps whose panels a worker may hold at once
+    static constexpr int nbPanelBuffers = 2;
+
+    ///
+    /// \brief DistributedMatrixMultiplier
+    /// \param gridSize Number of processes per row (and column) of the grid
+    /// \param nbThreadsPerProcess Threads of the multiplier of each process, 0 to share
+    ///        the cores of the machine between the processes
+    ///
+    /// Forks the helper process, throws std::runtime_error if it cannot.
+    ///
+    explicit DistributedMatrixMultiplier(int gridSize, int nbThreadsPerProcess = 0)
+        : gridSize(gridSize), nbThreadsPerProcess(nbThreadsPerProcess)
+    {
+        if (gridSize < 1) {
+            throw std::invalid_argument("gridSize must be positive");
+        }
+        if (nbThreadsPerProcess <= 0) {
+            int nbCores = static_cast<int>(std::thread::hardware_concurrency());
+            this->nbThreadsPerProcess = std::max(1, nbCores / (gridSize * gridSize));
+        }
+
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+            throw std::runtime_error("socketpair failed: " + std::to_string(errno));
+        }
+        helper = fork();
+        if (helper < 0) {
+            close(fds[0]);
+            close(fds[1]);
+            throw std::runtime_error("fork failed: " + std::to_string(errno));
+        }
+        if (helper == 0) {
+            // never return into the caller's code, whatever happens
+            try {
+                closeInheritedFiles(fds[1]);
+                runHelper(fds[1]);
+            }
+            catch (...) {
+                _exit(1);
+            }
+            _exit(0);
+        }
+        close(fds[1]);
+        helperSocket = fds[0];
+    }
+
+    DistributedMatrixMultiplier(const DistributedMatrixMultiplier&) = delete;
+    DistributedMatrixMultiplier& operator=(const DistributedMatrixMultiplier&) = delete;
+
+    //! Stops the helper process: it exits when its socket is closed
+    ~DistributedMatrixMultiplier()
+    {
+        closeSocket(helperSocket);
+        waitWorkers({helper});
+    }
+
+    [[nodiscard]] int getNbProcesses() const { return gridSize * gridSize; }
+
+    [[nodiscard]] int getNbThreadsPerProcess() const { return nbThreadsPerProcess; }
+
+    ///
+    /// \brief multiply
+    /// \param A First matrix
+    /// \param B Second matrix
+    /// \param C Result of AxB
+    ///
+    /// gridSize must divide the size of the matrices. Throws std::runtime_error if a
+    /// process fails. Concurrent calls are run one after the other.
+    ///
+    void multiply(const SquareMatrix<T>& A, const SquareMatrix<T>& B, SquareMatrix<T>& C) override
+    {
+        std::size_t size = A.size();
+        if (B.size() != size || C.size() != size) {
+            throw std::invalid_argument("The sizes of A, B and C must match");
+        }
+        if (size % static_cast<std::size_t>(gridSize) != 0) {
+            throw std::invalid_argument("gridSize must divide the size of the matrix");
+        }
+
+        std::size_t matrixBytes = size * size * sizeof(T);
+        std::uint64_t header = size;
+        std::uint8_t status = 0;
+
+        mutex.lock();
+        bool ok = sendAll(helperSocket, &header, sizeof(header)) &&
+                  sendAll(helperSocket, A.data(), matrixBytes) &&
+                  sendAll(helperSocket, B.data(), matrixBytes) &&
+                  receiveAll(helperSocket, &status, sizeof(status)) &&
+                  status == 1 &&
+                  receiveAll(helperSocket, C.data(), matrixBytes);
+        mutex.unlock();
+
+        if (!ok) {
+            throw std::runtime_error("A process of the distributed multiplication failed");
+        }
+        C.touch();
+    }
+
+private:
+    ///
+    /// Body of the helper process: one product per request of the socket, until it
+    /// is closed.
+    ///
+    void runHelper(int socket) const
+    {
+        for (;;) {
+            std::uint64_t size = 0;
+            if (!receiveAll(socket, &size, sizeof(size))) {
+                return;
+            }
+            std::vector<T> a(size * size);
+            std::vector<T> b(size * size);
+            std::vector<T> c(size * size);
+            if (!receiveAll(socket, a.data(), a.size() * sizeof(T)) ||
+                !receiveAll(socket, b.data(), b.size() * sizeof(T))) {
+                return;
+            }
+
+            std::uint8_t status = runGrid(size, a.data(), b.data(), c.data()) ? 1 : 0;
+            if (!sendAll(socket, &status, sizeof(status)) ||
+                (status == 1 && !sendAll(socket, c.data(), c.size() * sizeof(T)))) {
+                return;
+            }
+        }
+    }
+
+    ///
+    /// Forks the grid, scatters the blocks of a and b (size x size, row-major), and
+    /// gathers the blocks of c. Returns false if a process failed.
+    ///
+    bool runGrid(std::size_t size, const T* a, const T* b, T* c) const
+    {
+        std::size_t q = gridSize;
+        std::size_t blockSize = size / q;
+        std::size_t nbProcesses = q * q;
+
+        // all the sockets are created before forking, each process closes those of the others
+        std::vector<int> parentEnds(nbProcesses, -1);
+        std::vector<int> workerEnds(nbProcesses, -1);
+        // peer[p * nbProcesses + o]: socket of p to talk to o, for o in the row or column of p
+        std::vector<int> peer(nbProcesses * nbProcesses, -1);
+
+        auto closeAll = [&]() {
+            for (int& fd : parentEnds) closeSocket(fd);
+            for (int& fd : workerEnds) closeSocket(fd);
+            for (int& fd : peer) closeSocket(fd);
+        };
+
+        for (std::size_t p = 0; p < nbProcesses; p++) {
+            int fds[2];
+            if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+                closeAll();
+                return false;
+            }
+            parentEnds[p] = fds[0];
+            workerEnds[p] = fds[1];
+            for (std::size_t o = 0; o < p; o++) {
+                if (!sameRowOrColumn(p, o)) {
+                    continue;
+                }
+                if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+                    closeAll();
+                    return false;
+                }
+                peer[p * nbProcesses + o] = fds[0];
+                peer[o * nbProcesses + p] = fds[1];
+            }
+        }
+
+        std::vector<pid_t> workers;
+        for (std::size_t p = 0; p < nbProcesses; p++) {
+            pid_t pid = fork();
+            if (pid < 0) {
+                closeAll();
+                waitWorkers(workers);
+                return false;
+            }
+            if (pid == 0) {
+                // worker: keeps its own sockets only, so that a dead process is seen as EOF
+                try {
+                    for (std::size_t o = 0; o < nbProcesses; o++) {
+                        closeSocket(parentEnds[o]);
+                        if (o != p) {
+                            closeSocket(workerEnds[o]);
+                            for (std::size_t r = 0; r < nbProcesses; r++) {
+                                closeSocket(peer[o * nbProcesses + r]);
+                            }
+                        }
+                    }
+                    bool ok = runWorker(p, blockSize, workerEnds[p], &peer[p * nbProcesses]);
+                    _exit(ok ? 0 : 1);
+                }
+                catch (...) {
+                    _exit(1);
+                }
+            }
+            workers.push_back(pid);
+        }
+
+        for (int& fd : workerEnds) closeSocket(fd);
+        for (int& fd : peer) closeSocket(fd);
+
+        // scatter the blocks, then gather the blocks of C
+        bool ok = true;
+        std::vector<T> block(blockSize * blockSize);
+        for (std::size_t p = 0; p < nbProcesses && ok; p++) {
+            copyBlock(a, size, p / q, p % q, blockSize, block.data());
+            ok = sendAll(parentEnds[p], block.data(), block.size() * sizeof(T));
+            copyBlock(b, size, p / q, p % q, blockSize, block.data());
+            ok = ok && sendAll(parentEnds[p], block.data(), block.size() * sizeof(T));
+        }
+        for (std::size_t p = 0; p < nbProcesses && ok; p++) {
+            ok = receiveAll(parentEnds[p], block.data(), block.size() * sizeof(T));
+            if (ok) {
+                std::size_t r = p / q;
+                std::size_t col = p % q;
+                for (std::size_t y = 0; y < blockSize; y++) {
+                    std::copy(block.data() + y * blockSize, block.data() + (y + 1) * blockSize,
+                              c + (r * blockSize + y) * size + col * blockSize);
+                }
+            }
+        }
+
+        for (int& fd : parentEnds) closeSocket(fd);
+        return waitWorkers(workers) && ok;
+    }
+
+    bool sameRowOrColumn(std::size_t p, std::size_t o) const
+    {
+        std::size_t q = gridSize;
+        return p != o && (p / q == o / q || p % q == o % q);
+    }
+
+    static void closeSocket(int& fd)
+    {
+        if (fd >= 0) {
+            close(fd);
+            fd = -1;
+        }
+    }
+
+    ///
+    /// Closes every file of the process but the standard streams and keep, so that
+    /// the helper does not hold the sockets of the other multipliers open: their
+    /// helpers would never see them closed.
+    ///
+    static void closeInheritedFiles(int keep)
+    {
+        std::vector<int> inherited;
+        DIR* directory = opendir("/proc/self/fd");
+        if (directory == nullptr) {
+            throw std::runtime_error("Cannot list the files of the helper process");
+        }
+        while (dirent* entry = readdir(directory)) {
+            int fd = std::atoi(entry->d_name);
+            if (fd > STDERR_FILENO && fd != keep && fd != dirfd(directory)) {
+                inherited.push_back(fd);
+            }
+        }
+        closedir(directory);
+        for (int fd : inherited) {
+            close(fd);
+        }
+    }
+
+    static bool sendAll(int fd, const void* data, std::size_t bytes)
+    {
+        const char* p = static_cast<const char*>(data);
+        while (bytes > 0) {
+            ssize_t n = send(fd, p, bytes, MSG_NOSIGNAL);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            p += n;
+            bytes -= static_cast<std::size_t>(n);
+        }
+        return true;
+    }
+
+    static bool receiveAll(int fd, void* data, std::size_t bytes)
+    {
+        char* p = static_cast<char*>(data);
+        while (bytes > 0) {
+            ssize_t n = recv(fd, p, bytes, 0);
+            if (n < 0 && errno == EINTR) {
+                continue;
+            }
+            if (n <= 0) {
+                return false;
+            }
+            p += n;
+            bytes -= static_cast<std::size_t>(n);
+        }
+        return true;
+    }
+
+    static bool waitWorkers(const std::vector<pid_t>& workers)
+    {
+        bool ok = true;
+        for (pid_t pid : workers) {
+            int status = 0;
+            while (waitpid(pid, &status, 0) < 0 && errno == EINTR) {
+            }
+            ok = ok && WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        }
+        return ok;
+    }
+
+    //! Copies block (r, c) of the size x size row-major matrix m
+    static void copyBlock(const T* m, std::size_t size, std::size_t r, std::size_t c, std::size_t blockSize, T* block)
+    {
+        for (std::size_t y = 0; y < blockSize; y++) {
+            const T* row = m + (r * blockSize + y) * size + c * blockSize;
+            std::copy(row, row + blockSize, block + y * blockSize);
+        }
+    }
+
+    //! Blocks per row of the multiplier of a worker: the fewest keeping blocks of at most 128
+    static std::size_t subBlocksPerRow(std::size_t blockSize)
+    {
+        return std::max<std::size_t>(1, (blockSize + 127) / 128);
+    }
+
+    //! Size of the blocks of a worker once padded to a multiple of subBlocksPerRow()
+    static std::size_t paddedSize(std::size_t blockSize)
+    {
+        std::size_t nbBlocks = subBlocksPerRow(blockSize);
+        return nbBlocks * ((blockSize + nbBlocks - 1) / nbBlocks);
+    }
+
+    //! Copies the blockSize x blockSize block into the top left corner of padded, zeroing the rest
+    static void padBlock(const T* block, std::size_t blockSize, SquareMatrix<T>& padded)
+    {
+        std::size_t size = padded.size();
+        T* data = padded.data();
+        for (std::size_t y = 0; y < blockSize; y++) {
+            std::copy(block + y * blockSize, block + (y + 1) * blockSize, data + y * size);
+            std::fill(data + y * size + blockSize, data + (y + 1) * size, T(0));
+        }
+        std::fill(data + blockSize * size, data + size * size, T(0));
+    }
+
+    ///
+    /// Panels of the steps, filled by the communication thread and consumed by the
+    /// computation, in a ring of nbPanelBuffers slots.
+    ///
+    struct PanelRing
+    {
+        std::vector<std::unique_ptr<SquareMatrix<T>>> a;
+        std::vector<std::unique_ptr<SquareMatrix<T>>> b;
+        PcoMutex mutex;
+        PcoConditionVariable changed;
+        std::size_t nbReceived = 0; // steps whose panels are in the ring
+        std::size_t nbConsumed = 0; // steps already computed
+        bool failed = false;
+    };
+
+    //! Receives or broadcasts the panels of every step into ring, for worker (r, c)
+    void communicate(PanelRing& ring, std::size_t r, std::size_t c, const SquareMatrix<T>& ownA,
+                     const SquareMatrix<T>& ownB, const int* peers) const
+    {
+        std::size_t q = gridSize;
+        std::size_t blockBytes = ownA.size() * ownA.size() * sizeof(T);
+
+        for (std::size_t k = 0; k < q; k++) {
+            ring.mutex.lock();
+            while (ring.nbReceived - ring.nbConsumed >= nbPanelBuffers) {
+                ring.changed.wait(&ring.mutex);
+            }
+            ring.mutex.unlock();
+
+            T* a = ring.a[k % nbPanelBuffers]->data();
+            T* b = ring.b[k % nbPanelBuffers]->data();
+
+            // row broadcast of A(r, k) by process (r, k), then column one of B(k, c) by (k, c)
+            bool ok = true;
+            if (c == k) {
+                std::copy(ownA.data(), ownA.data() + ownA.size() * ownA.size(), a);
+                for (std::size_t other = 0; other < q && ok; other++) {
+                    if (other != c) {
+                        ok = sendAll(peers[r * q + other], a, blockBytes);
+                    }
+                }
+            }
+            else {
+                ok = receiveAll(peers[r * q + k], a, blockBytes);
+            }
+            if (r == k) {
+                std::copy(ownB.data(), ownB.data() + ownB.size() * ownB.size(), b);
+                for (std::size_t other = 0; other < q && ok; other++) {
+                    if (other != r) {
+                        ok = sendAll(peers[other * q + c], b, blockBytes);
+                    }
+                }
+            }
+            else if (ok) {
+                ok = receiveAll(peers[k * q + c], b, blockBytes);
+            }
+
+            ring.mutex.lock();
+            if (ok) {
+                ring.nbReceived++;
+            }
+            else {
+                ring.failed = true;
+            }
+            ring.changed.notifyAll();
+            ring.mutex.unlock();
+            if (!ok) {
+                return;
+            }
+        }
+    }
+
+    ///
+    /// Body of worker p: receives its blocks, runs the SUMMA steps and sends its block
+    /// of C back. peers[o] is the socket towards worker o. Panels travel padded.
+    ///
+    bool runWorker(std::size_t p, std::size_t blockSize, int parent, const int* peers) const
+    {
+        std::size_t q = gridSize;
+        std::size_t blockBytes = blockSize * blockSize * sizeof(T);
+        std::size_t size = paddedSize(blockSize);
+
+        std::vector<T> block(blockSize * blockSize);
+        SquareMatrix<T> ownA(size);
+        SquareMatrix<T> ownB(size);
+        if (!receiveAll(parent, block.data(), blockBytes)) {
+            return false;
+        }
+        padBlock(block.data(), blockSize, ownA);
+        if (!receiveAll(parent, block.data(), blockBytes)) {
+            return false;
+        }
+        padBlock(block.data(), blockSize, ownB);
+
+        PanelRing ring;
+        for (int slot = 0; slot < nbPanelBuffers; slot++) {
+            ring.a.push_back(std::make_unique<SquareMatrix<T>>(size));
+            ring.b.push_back(std::make_unique<SquareMatrix<T>>(size));
+        }
+
+        ThreadedMatrixMultiplier<T> multiplier(nbThreadsPerProcess, static_cast<int>(subBlocksPerRow(blockSize)));
+        SquareMatrix<T> sum(size);
+        SquareMatrix<T> product(size);
+
+        PcoThread communication([&]() { communicate(ring, p / q, p % q, ownA, ownB, peers); });
+
+        // C(r, c) = sum over k of A(r, k) * B(k, c)
+        bool ok = true;
+        for (std::size_t k = 0; k < q; k++) {
+            ring.mutex.lock();
+            while (!ring.failed && ring.nbReceived <= k) {
+                ring.changed.wait(&ring.mutex);
+            }
+            ok = !ring.failed;
+            ring.mutex.unlock();
+            if (!ok) {
+                break;
+            }
+
+            const SquareMatrix<T>& a = *ring.a[k % nbPanelBuffers];
+            const SquareMatrix<T>& b = *ring.b[k % nbPanelBuffers];
+            if (k == 0) {
+                multiplier.multiply(a, b, sum);
+            }
+            else {
+                multiplier.multiply(a, b, product);
+                T* sumData = sum.data();
+                const T* productData = product.data();
+                for (std::size_t e = 0; e < size * size; e++) {
+                    sumData[e] += productData[e];
+                }
+            }
+
+            ring.mutex.lock();
+            ring.nbConsumed++;
+            ring.changed.notifyAll();
+            ring.mutex.unlock();
+        }
+        communication.join();
+        if (!ok) {
+            return false;
+        }
+
+        for (std::size_t y = 0; y < blockSize; y++) {
+            std::copy(sum.data() + y * size, sum.data() + y * size + blockSize, block.data() + y * blockSize);
+        }
+        return sendAll(parent, block.data(), blockBytes);
+    }
+
+    int gridSize;
+    int nbThreadsPerProcess;
+    pid_t helper = -1;
+    int helperSocket = -1;
+    PcoMutex mutex;
+};
+
+#endif // DISTRIBUTEDMATRIXMULTIPLIER_H
@@ -0,0 +1,213 @@
+#ifndef DOTPRODUCT_H
+#define DOTPRODUCT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+#include "lowprecision.h"
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define MATRIX_X86_DISPATCH 1
+#include <immintrin.h>
+#endif
+
+/**
+ * Dot products of two contiguous vectors, the inner loop of the multipliers.
+ *
+ * The generic version converts every input to the accumulator type before the
+ * multiply-add. The narrow input types have vectorized kernels, picked once at run
+ * time from the CPU features, with the generic version as fallback:
+ * - int8_t -> int32_t: AVX-512 VNNI or AVX-VNNI (vpdpbusd, 32 bytes per
+ *   instruction), else AVX2 (vpmaddwd, 16),
+ * - BFloat16 -> float: AVX2 + FMA, bf16 being widened by a shift,
+ * - Float16 -> float: F16C + FMA.
+ */
+template<class TAcc, class TIn>
+inline TAcc dotProductScalar(const TIn* a, const TIn* b, std::size_t n)
+{
+    TAcc result{};
+    for (std::size_t k = 0; k < n; k++) {
+        result += static_cast<TAcc>(a[k]) * static_cast<TAcc>(b[k]);
+    }
+    return result;
+}
+
+#ifdef MATRIX_X86_DISPATCH
+namespace dotproduct_detail {
+
+__attribute__((target("avx2"))) inline std::int32_t horizontalSum(__m256i v)
+{
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(v), _mm256_extracti128_si256(v, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum);
+}
+
+__attribute__((target("avx2"))) inline float horizontalSum(__m256 v)
+{
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_movehdup_ps(sum));
+    return _mm_cvtss_f32(sum);
+}
+
+__attribute__((target("avx2"))) inline __m256i loadInt8AsInt16(const std::int8_t* p)
+{
+    return _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+}
+
+__attribute__((target("avx2"))) inline __m256i loadInt8(const std::int8_t* p)
+{
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+
+//! a . b from sum of (a + 128) * b and sum of b, both summed as unsigned to wrap like int32
+inline std::int32_t removeInt8Bias(std::int32_t biasedProduct, std::int32_t sumB)
+{
+    return static_cast<std::int32_t>(static_cast<std::uint32_t>(biasedProduct) - 128u * static_cast<std::uint32_t>(sumB));
+}
+
+// vpdpbusd multiplies unsigned by signed bytes, 32 of them per instruction: a is
+// moved to unsigned by flipping its sign bit (a + 128), and 128 * sum(b) removed
+// at the end, sum(b) coming from a second vpdpbusd against ones.
+__attribute__((target("avx512vnni,avx512vl,avx2")))
+inline std::int32_t dotInt8Avx512Vnni(const std::int8_t* a, const std::int8_t* b, std::size_t n)
+{
+    const __m256i bias = _mm256_set1_epi8(static_cast<char>(0x80));
+    const __m256i ones = _mm256_set1_epi8(1);
+    __m256i acc = _mm256_setzero_si256();
+    __m256i sumB = _mm256_setzero_si256();
+    std::size_t k = 0;
+    for (; k + 32 <= n; k += 32) {
+        __m256i vb = loadInt8(b + k);
+        acc = _mm256_dpbusd_epi32(acc, _mm256_xor_si256(loadInt8(a + k), bias), vb);
+        sumB = _mm256_dpbusd_epi32(sumB, ones, vb);
+    }
+    return removeInt8Bias(horizontalSum(acc), horizontalSum(sumB)) + dotProductScalar<std::int32_t>(a + k, b + k, n - k);
+}
+
+//! Same as dotInt8Avx512Vnni with the VEX encoded AVX-VNNI, for CPUs without AVX-512
+__attribute__((target("avxvnni,avx2")))
+inline std::int32_t dotInt8AvxVnni(const std::int8_t* a, const std::int8_t* b, std::size_t n)
+{
+    const __m256i bias = _mm256_set1_epi8(static_cast<char>(0x80));
+    const __m256i ones = _mm256_set1_epi8(1);
+    __m256i acc = _mm256_setzero_si256();
+    __m256i sumB = _mm256_setzero_si256();
+    std::size_t k = 0;
+    for (; k + 32 <= n; k += 32) {
+        __m256i vb = loadInt8(b + k);
+        acc = _mm256_dpbusd_avx_epi32(acc, _mm256_xor_si256(loadInt8(a + k), bias), vb);
+        sumB = _mm256_dpbusd_avx_epi32(sumB, ones, vb);
+    }
+    return removeInt8Bias(horizontalSum(acc), horizontalSum(sumB)) + dotProductScalar<std::int32_t>(a + k, b + k, n - k);
+}
+
+__attribute__((target("avx2")))
+inline std::int32_t dotInt8Avx2(const std::int8_t* a, const std::int8_t* b, std::size_t n)
+{
+    __m256i acc = _mm256_setzero_si256();
+    std::size_t k = 0;
+    for (; k + 16 <= n; k += 16) {
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(loadInt8AsInt16(a + k), loadInt8AsInt16(b + k)));
+    }
+    return horizontalSum(acc) + dotProductScalar<std::int32_t>(a + k, b + k, n - k);
+}
+
+__attribute__((target("avx2"))) inline __m256 loadBFloat16(const BFloat16* p)
+{
+    __m256i widened = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p)));
+    return _mm256_castsi256_ps(_mm256_slli_epi32(widened, 16));
+}
+
+__attribute__((target("avx2,fma")))
+inline float dotBFloat16Avx2(const BFloat16* a, const BFloat16* b, std::size_t n)
+{
+    __m256 acc = _mm256_setzero_ps();
+    std::size_t k = 0;
+    for (; k + 8 <= n; k += 8) {
+        acc = _mm256_fmadd_ps(loadBFloat16(a + k), loadBFloat16(b + k), acc);
+    }
+    return horizontalSum(acc) + dotProductScalar<float>(a + k, b + k, n - k);
+}
+
+__attribute__((target("avx2,fma,f16c")))
+inline float dotFloat16F16c(const Float16* a, const Float16* b, std::size_t n)
+{
+    __m256 acc = _mm256_setzero_ps();
+    std::size_t k = 0;
+    for (; k + 8 <= n; k += 8) {
+        __m256 va = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + k)));
+        __m256 vb = _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + k)));
+        acc = _mm256_fmadd_ps(va, vb, acc);
+    }
+    return horizontalSum(acc) + dotProductScalar<float>(a + k, b + k, n - k);
+}
+
+template<class TAcc, class TIn>
+using Kernel = TAcc (*)(const TIn*, const TIn*, std::size_t);
+
+inline Kernel<std::int32_t, std::int8_t> selectInt8Kernel()
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512vnni") && __builtin_cpu_supports("avx512vl")) {
+        return dotInt8Avx512Vnni;
+    }
+    if (__builtin_cpu_supports("avxvnni")) {
+        return dotInt8AvxVnni;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return dotInt8Avx2;
+    }
+    return dotProductScalar<std::int32_t, std::int8_t>;
+}
+
+inline Kernel<float, BFloat16> selectBFloat16Kernel()
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return dotBFloat16Avx2;
+    }
+    return dotProductScalar<float, BFloat16>;
+}
+
+inline Kernel<float, Float16> selectFloat16Kernel()
+{
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c")) {
+        return dotFloat16F16c;
+    }
+    return dotProductScalar<float, Float16>;
+}
+
+} // namespace dotproduct_detail
+#endif // MATRIX_X86_DISPATCH
+
+///
+/// \brief dot product of a[0..n) and b[0..n), accumulated in TAcc
+///
+template<class TAcc, class TIn>
+inline TAcc dotProduct(const TIn* a, const TIn* b, std::size_t n)
+{
+#ifdef MATRIX_X86_DISPATCH
+    if constexpr (std::is_same<TIn, std::int8_t>::value && std::is_same<TAcc, std::int32_t>::value) {
+        static const auto kernel = dotproduct_detail::selectInt8Kernel();
+        return kernel(a, b, n);
+    }
+    else if constexpr (std::is_same<TIn, BFloat16>::value && std::is_same<TAcc, float>::value) {
+        static const auto kernel = dotproduct_detail::selectBFloat16Kernel();
+        return kernel(a, b, n);
+    }
+    else if constexpr (std::is_same<TIn, Float16>::value && std::is_same<TAcc, float>::value) {
+        static const auto kernel = dotproduct_detail::selectFloat16Kernel();
+        return kernel(a, b, n);
+    }
+    else
+#endif
+    {
+        return dotProductScalar<TAcc>(a, b, n);
+    }
+}
+
+#endif // DOTPRODUCT_H
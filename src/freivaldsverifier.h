@@ -0,0 +1,224 @@
+#ifndef FREIVALDSVERIFIER_H
+#define FREIVALDSVERIFIER_H
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "abstractmatrixmultiplier.h"
+#include "matrix.h"
+#include "parallelfor.h"
+
+/**
+ * Probabilistic check of a product C = A * B in O(N^2) (Freivalds' algorithm).
+ *
+ * Each round draws a random vector x in {0, 1}^N and checks A * (B * x) == C * x.
+ * A wrong C passes a round with a probability of at most 1/2, so the number of
+ * rounds is chosen to keep the probability of accepting a wrong result below
+ * falsePositiveBound. All rounds are done together: each matrix is read once,
+ * row after row, by several threads.
+ *
+ * A, B are matrices of TIn and C of TOut, the multipliers summing in TAcc.
+ * Integral accumulators are checked exactly, in the unsigned type of the same
+ * width, so that products which overflow are compared modulo 2^n as the
+ * multipliers compute them. Other types are checked in double, a row being
+ * accepted if the difference is below the sum of two rounding errors:
+ * - the accumulation, tolerance * sqrt(N) * sqrt(A^2 * (B^2 * x) + C^2 * x), squares
+ *   taken element-wise: the rounding error of a dot product grows like sqrt(N)
+ *   times the norm of its terms, not like the sum of their magnitudes, which would
+ *   hide small but real errors in large matrices,
+ * - the rounding of each element to TOut, eps(TOut) * (|C| * x), at most half an
+ *   ulp per element, independent of N.
+ * Sums of narrow storage types (BFloat16, Float16) are computed in float, whose
+ * precision is the one of the accumulation.
+ */
+template<class TIn, class TAcc = TIn, class TOut = TAcc>
+class FreivaldsVerifier
+{
+    static constexpr bool isExact = std::is_integral<TAcc>::value;
+
+    using Value = typename std::conditional<isExact,
+                                            typename std::make_unsigned<typename std::conditional<isExact, TAcc, int>::type>::type,
+                                            double>::type;
+
+    //! Type in which sums of TAcc are computed
+    using Arithmetic = decltype(std::declval<TAcc>() + std::declval<TAcc>());
+
+public:
+    //! A few ulps per term of the accumulation, for non integral types
+    static double defaultTolerance()
+    {
+        if constexpr (isExact) {
+            return 0.0;
+        }
+        else {
+            return 16.0 * static_cast<double>(std::numeric_limits<Arithmetic>::epsilon());
+        }
+    }
+
+    ///
+    /// \brief FreivaldsVerifier
+    /// \param falsePositiveBound Maximal probability of accepting a wrong product
+    /// \param tolerance Relative tolerance per term of the accumulation, for non integral types
+    /// \param seed Seed of the random vectors, each verify() derives its own from it
+    ///
+    explicit FreivaldsVerifier(double falsePositiveBound = 1e-9,
+                               double tolerance = defaultTolerance(),
+                               std::uint64_t seed = std::random_device{}())
+        : tolerance(tolerance), seed(seed)
+    {
+        if (!(falsePositiveBound > 0.0) || falsePositiveBound >= 1.0) {
+            throw std::invalid_argument("falsePositiveBound must be in ]0, 1[");
+        }
+        nbRounds = std::max(1, static_cast<int>(std::ceil(-std::log2(falsePositiveBound))));
+    }
+
+    FreivaldsVerifier(const FreivaldsVerifier&) = delete;
+    FreivaldsVerifier& operator=(const FreivaldsVerifier&) = delete;
+
+    [[nodiscard]] int getNbRounds() const { return nbRounds; }
+
+    ///
+    /// \brief verify
+    /// \param A First matrix
+    /// \param B Second matrix
+    /// \param C Result to check
+    /// \return true if C = A * B, up to the false positive bound
+    ///
+    /// Reentrant: concurrent calls use different random vectors.
+    ///
+    bool verify(const SquareMatrix<TIn>& A, const SquareMatrix<TIn>& B, const SquareMatrix<TOut>& C) const
+    {
+        std::size_t n = A.size();
+        if (B.size() != n || C.size() != n) {
+            return false;
+        }
+
+        std::size_t k = static_cast<std::size_t>(nbRounds);
+
+        // X is N x k, column t being the vector of round t
+        std::mt19937_64 rng(seed + 0x9e3779b97f4a7c15ULL * nbCalls.fetch_add(1));
+        std::vector<Value> X(n * k);
+        for (std::size_t i = 0; i < X.size(); i += 64) {
+            std::uint64_t bits = rng();
+            for (std::size_t b = 0; b < 64 && i + b < X.size(); b++) {
+                X[i + b] = static_cast<Value>((bits >> b) & 1);
+            }
+        }
+
+        // BX = B * X, then ABX = A * BX and CX = C * X
+        std::vector<Value> BX(n * k), ABX(n * k), CX(n * k);
+        product(B, X, BX, k);
+        product(A, BX, ABX, k);
+        product(C, X, CX, k);
+
+        if constexpr (isExact) {
+            return ABX == CX;
+        }
+        else {
+            std::vector<Value> sqBX(n * k), sqABX(n * k), sqCX(n * k), absCX(n * k);
+            squareProduct(B, X, sqBX, k);
+            squareProduct(A, sqBX, sqABX, k);
+            squareProduct(C, X, sqCX, k);
+            rowsProduct(C, X, absCX, k, [](TOut v) { return std::abs(static_cast<Value>(v)); });
+
+            double scale = tolerance * std::sqrt(static_cast<double>(n));
+            double outputRounding = static_cast<double>(std::numeric_limits<TOut>::epsilon());
+            for (std::size_t i = 0; i < n * k; i++) {
+                double bound = scale * std::sqrt(sqABX[i] + sqCX[i]) + outputRounding * absCX[i] +
+                               std::numeric_limits<double>::min();
+                if (!(std::abs(ABX[i] - CX[i]) <= bound)) {
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+
+private:
+    //! Y = M * X for X of k columns, stored row-major
+    template<class T>
+    static void product(const SquareMatrix<T>& M, const std::vector<Value>& X, std::vector<Value>& Y, std::size_t k)
+    {
+        rowsProduct(M, X, Y, k, [](T v) { return static_cast<Value>(v); });
+    }
+
+    //! Y = M^2 * X, M^2 being the element-wise square of M
+    template<class T>
+    static void squareProduct(const SquareMatrix<T>& M, const std::vector<Value>& X, std::vector<Value>& Y, std::size_t k)
+    {
+        rowsProduct(M, X, Y, k, [](T v) { return static_cast<Value>(v) * static_cast<Value>(v); });
+    }
+
+    template<class T, class Convert>
+    static void rowsProduct(const SquareMatrix<T>& M, const std::vector<Value>& X, std::vector<Value>& Y,
+                            std::size_t k, Convert convert)
+    {
+        std::size_t n = M.size();
+        std::size_t minRows = minRowsPerThread(n);
+        parallelFor(0, n, minRows, [&](std::size_t rowBegin, std::size_t rowEnd) {
+            for (std::size_t r = rowBegin; r < rowEnd; r++) {
+                const T* row = M.data() + r * M.stride();
+                Value* y = Y.data() + r * k;
+                std::fill(y, y + k, Value(0));
+                for (std::size_t c = 0; c < n; c++) {
+                    Value m = convert(row[c]);
+                    const Value* x = X.data() + c * k;
+                    for (std::size_t t = 0; t < k; t++) {
+                        y[t] += m * x[t];
+                    }
+                }
+            }
+        });
+    }
+
+    double tolerance;
+    std::uint64_t seed;
+    int nbRounds;
+    mutable std::atomic<std::uint64_t> nbCalls{0};
+};
+
+
+/**
+ * Wraps a multiplier to check every product it computes with a FreivaldsVerifier,
+ * as a self-check in production. multiply() throws std::runtime_error if the
+ * product is found to be wrong.
+ */
+template<class TIn, class TAcc = TIn, class TOut = TAcc>
+class VerifiedMatrixMultiplier : public AbstractMatrixMultiplier<TIn, TAcc, TOut>
+{
+public:
+    ///
+    /// \brief VerifiedMatrixMultiplier
+    /// \param multiplier Multiplier doing the work, must outlive this object
+    /// \param falsePositiveBound Maximal probability of accepting a wrong product
+    /// \param tolerance Relative tolerance per term for non integral types
+    ///
+    explicit VerifiedMatrixMultiplier(AbstractMatrixMultiplier<TIn, TAcc, TOut>& multiplier,
+                                      double falsePositiveBound = 1e-9,
+                                      double tolerance = FreivaldsVerifier<TIn, TAcc, TOut>::defaultTolerance())
+        : multiplier(multiplier), verifier(falsePositiveBound, tolerance)
+    {
+    }
+
+    void multiply(const SquareMatrix<TIn>& A, const SquareMatrix<TIn>& B, SquareMatrix<TOut>& C) override
+    {
+        multiplier.multiply(A, B, C);
+        if (!verifier.verify(A, B, C)) {
+            throw std::runtime_error("Matrix product failed verification");
+        }
+    }
+
+private:
+    AbstractMatrixMultiplier<TIn, TAcc, TOut>& multiplier;
+    FreivaldsVerifier<TIn, TAcc, TOut> verifier;
+};
+
+#endif // FREIVALDSVERIFIER_H
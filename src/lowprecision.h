@@ -0,0 +1,195 @@
+#ifndef LOWPRECISION_H
+#define LOWPRECISION_H
+
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+
+/**
+ * Narrow floating point element types, used as multiplier inputs with a float
+ * accumulator. Both only store their bits: arithmetic is done after the implicit
+ * conversion to float, and a float is rounded back (to nearest even) by the
+ * explicit constructor.
+ */
+
+///
+/// bfloat16: the upper half of an IEEE float (8 bits exponent, 7 bits mantissa).
+///
+class BFloat16
+{
+public:
+    BFloat16() = default;
+
+    //! The value whose representation is bits
+    static constexpr BFloat16 fromBits(std::uint16_t bits)
+    {
+        BFloat16 value{};
+        value.bits = bits;
+        return value;
+    }
+
+    explicit BFloat16(float value)
+    {
+        std::uint32_t f;
+        std::memcpy(&f, &value, sizeof(f));
+        if ((f & 0x7fffffffu) > 0x7f800000u) {
+            // NaN, keep it quiet instead of rounding it to infinity
+            bits = static_cast<std::uint16_t>((f >> 16) | 0x0040u);
+            return;
+        }
+        f += 0x7fffu + ((f >> 16) & 1u);
+        bits = static_cast<std::uint16_t>(f >> 16);
+    }
+
+    operator float() const
+    {
+        std::uint32_t f = static_cast<std::uint32_t>(bits) << 16;
+        float value;
+        std::memcpy(&value, &f, sizeof(value));
+        return value;
+    }
+
+    std::uint16_t bits;
+};
+
+///
+/// IEEE 754 binary16 (5 bits exponent, 10 bits mantissa).
+///
+class Float16
+{
+public:
+    Float16() = default;
+
+    //! The value whose representation is bits
+    static constexpr Float16 fromBits(std::uint16_t bits)
+    {
+        Float16 value{};
+        value.bits = bits;
+        return value;
+    }
+
+    explicit Float16(float value)
+    {
+        std::uint32_t f;
+        std::memcpy(&f, &value, sizeof(f));
+        std::uint32_t sign = (f >> 16) & 0x8000u;
+        std::uint32_t absF = f & 0x7fffffffu;
+
+        if (absF > 0x7f800000u) {
+            bits = static_cast<std::uint16_t>(sign | 0x7e00u);
+        }
+        else if (absF >= 0x477ff000u) {
+            // rounds above the largest half (65504)
+            bits = static_cast<std::uint16_t>(sign | 0x7c00u);
+        }
+        else if (absF < 0x38800000u) {
+            // subnormal half: round |value| * 2^24 to an integer, the float adder does it
+            float magnitude;
+            std::memcpy(&magnitude, &absF, sizeof(magnitude));
+            magnitude += 0.5f;
+            std::uint32_t m;
+            std::memcpy(&m, &magnitude, sizeof(m));
+            bits = static_cast<std::uint16_t>(sign | (m - 0x3f000000u));
+        }
+        else {
+            std::uint32_t rounded = absF + 0xfffu + ((absF >> 13) & 1u) - (112u << 23);
+            bits = static_cast<std::uint16_t>(sign | (rounded >> 13));
+        }
+    }
+
+    operator float() const
+    {
+        std::uint32_t sign = static_cast<std::uint32_t>(bits & 0x8000u) << 16;
+        std::uint32_t exponent = (bits >> 10) & 0x1fu;
+        std::uint32_t mantissa = bits & 0x3ffu;
+        std::uint32_t f;
+
+        if (exponent == 0x1f) {
+            f = sign | 0x7f800000u | (mantissa << 13);
+        }
+        else if (exponent == 0) {
+            // zero or subnormal: mantissa * 2^-24
+            float value = static_cast<float>(mantissa) * (1.0f / 16777216.0f);
+            std::memcpy(&f, &value, sizeof(f));
+            f |= sign;
+        }
+        else {
+            f = sign | ((exponent + 112u) << 23) | (mantissa << 13);
+        }
+
+        float value;
+        std::memcpy(&value, &f, sizeof(value));
+        return value;
+    }
+
+    std::uint16_t bits;
+};
+
+inline std::ostream& operator<<(std::ostream& os, BFloat16 value)
+{
+    return os << static_cast<float>(value);
+}
+
+inline std::ostream& operator<<(std::ostream& os, Float16 value)
+{
+    return os << static_cast<float>(value);
+}
+
+/**
+ * Limits of the narrow types, so that generic code (tolerances, ...) sees their
+ * precision: epsilon() is 2^-7 for bfloat16 and 2^-10 for binary16.
+ */
+namespace std {
+
+template<>
+class numeric_limits<BFloat16>
+{
+public:
+    static constexpr bool is_specialized = true;
+    static constexpr bool is_signed = true;
+    static constexpr bool is_integer = false;
+    static constexpr bool is_exact = false;
+    static constexpr bool has_infinity = true;
+    static constexpr bool has_quiet_NaN = true;
+    static constexpr int radix = 2;
+    static constexpr int digits = 8;
+    static constexpr int min_exponent = -125;
+    static constexpr int max_exponent = 128;
+
+    static constexpr BFloat16 min() noexcept { return BFloat16::fromBits(0x0080); }
+    static constexpr BFloat16 lowest() noexcept { return BFloat16::fromBits(0xff7f); }
+    static constexpr BFloat16 max() noexcept { return BFloat16::fromBits(0x7f7f); }
+    static constexpr BFloat16 epsilon() noexcept { return BFloat16::fromBits(0x3c00); }
+    static constexpr BFloat16 infinity() noexcept { return BFloat16::fromBits(0x7f80); }
+    static constexpr BFloat16 quiet_NaN() noexcept { return BFloat16::fromBits(0x7fc0); }
+    static constexpr BFloat16 denorm_min() noexcept { return BFloat16::fromBits(0x0001); }
+};
+
+template<>
+class numeric_limits<Float16>
+{
+public:
+    static constexpr bool is_specialized = true;
+    static constexpr bool is_signed = true;
+    static constexpr bool is_integer = false;
+    static constexpr bool is_exact = false;
+    static constexpr bool has_infinity = true;
+    static constexpr bool has_quiet_NaN = true;
+    static constexpr int radix = 2;
+    static constexpr int digits = 11;
+    static constexpr int min_exponent = -13;
+    static constexpr int max_exponent = 16;
+
+    static constexpr Float16 min() noexcept { return Float16::fromBits(0x0400); }
+    static constexpr Float16 lowest() noexcept { return Float16::fromBits(0xfbff); }
+    static constexpr Float16 max() noexcept { return Float16::fromBits(0x7bff); }
+    static constexpr Float16 epsilon() noexcept { return Float16::fromBits(0x1400); }
+    static constexpr Float16 infinity() noexcept { return Float16::fromBits(0x7c00); }
+    static constexpr Float16 quiet_NaN() noexcept { return Float16::fromBits(0x7e00); }
+    static constexpr Float16 denorm_min() noexcept { return Float16::fromBits(0x0001); }
+};
+
+} // namespace std
+
+#endif // LOWPRECISION_H
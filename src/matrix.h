@@ -1,88 +1,200 @@
 #ifndef MATRIX_H
 #define MATRIX_H
 
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
 #include <iostream>
+#include <limits>
+#include <utility>
 #include <vector>
 
+#include "matrixallocator.h"
+#include "parallelfor.h"
+
+//! Identifier for a new matrix, never given twice in a process
+inline std::uint64_t newMatrixId()
+{
+    static std::atomic<std::uint64_t> nextId{1};
+    return nextId.fetch_add(1, std::memory_order_relaxed);
+}
+
 /**
  * A class representing a basic matrix.
  * It is a template so as to be generic enough.
  * The only requirement is that T should have a * operator in order to let
  * the multiplication be done correctly.
+ * The storage is obtained from Allocator, which by default is cache-line
+ * aligned, huge-page backed for large matrices, and leaves scalar elements
+ * uninitialised: the content of a new matrix is unspecified until written.
+ *
+ * Elements are stored row-major: element (x, y) is at data()[y * stride() + x].
+ * There is no virtual function, a Matrix is only its storage and its extents.
+ *
+ * Every matrix has an identifier, unique for the process, and a version which
+ * changes on assignment and on touch(). Together they tell caches whether a
+ * matrix may have changed since they last saw it. Element writes are not
+ * tracked, so that they cost no more than a store: code modifying a matrix a
+ * cache may hold calls touch() once it is done.
  * */
-template<class T>
+template<class T, class Allocator = MatrixAllocator<T>>
 class Matrix
 {
 public:
-    Matrix(int sx, int sy)
+    Matrix(std::size_t sx, std::size_t sy) : array(sx * sy), sizeX(sx), sizeY(sy), id(newMatrixId()) {}
+
+    //! A copy is a new matrix, with its own identifier
+    Matrix(const Matrix& other) : array(other.array), sizeX(other.sizeX), sizeY(other.sizeY), id(newMatrixId()) {}
+
+    //! The moved storage keeps its identifier and version, other is left empty
+    Matrix(Matrix&& other) noexcept
+        : array(std::move(other.array)), sizeX(other.sizeX), sizeY(other.sizeY), id(other.id),
+          version(other.version.load(std::memory_order_relaxed))
+    {
+        other.sizeX = 0;
+        other.sizeY = 0;
+        other.id = newMatrixId();
+    }
+
+    Matrix& operator=(const Matrix& other)
     {
-        array = std::vector<T>(sx * sy);
-        sizeX = sx;
-        sizeY = sy;
+        array = other.array;
+        sizeX = other.sizeX;
+        sizeY = other.sizeY;
+        touch();
+        return *this;
     }
 
-    virtual ~Matrix() = default;
+    Matrix& operator=(Matrix&& other) noexcept
+    {
+        array = std::move(other.array);
+        sizeX = other.sizeX;
+        sizeY = other.sizeY;
+        touch();
+        other.sizeX = 0;
+        other.sizeY = 0;
+        other.touch();
+        return *this;
+    }
 
-    inline T element(int x, int y) const
+    inline T element(std::size_t x, std::size_t y) const
     {
         return array[sizeX * y + x];
     }
 
-    inline void setElement(int x, int y, T value)
+    inline void setElement(std::size_t x, std::size_t y, T value)
     {
         array[sizeX * y + x] = value;
     }
 
+    //! Raw storage, row after row
+    inline T* data() { return array.data(); }
+
+    inline const T* data() const { return array.data(); }
+
+    //! Number of elements between the starts of two consecutive rows
+    [[nodiscard]] inline std::size_t stride() const { return sizeX; }
+
     void print() const
     {
-        for (int y = 0; y < sizeY; y++) {
-            for (int x = 0; x < sizeX; x++) {
+        for (std::size_t y = 0; y < sizeY; y++) {
+            for (std::size_t x = 0; x < sizeX; x++) {
                 std::cout << element(x, y) << " ";
             }
             std::cout << std::endl;
         }
     }
 
-    [[nodiscard]] int getSizeX() const { return sizeX; }
+    [[nodiscard]] std::size_t getSizeX() const { return sizeX; }
+
+    [[nodiscard]] std::size_t getSizeY() const { return sizeY; }
+
+    [[nodiscard]] std::uint64_t getId() const { return id; }
+
+    [[nodiscard]] std::uint64_t getVersion() const { return version.load(std::memory_order_relaxed); }
 
-    [[nodiscard]] int getSizeY() const { return sizeY; }
+    //! Records a modification of the elements, for the caches
+    inline void touch() { version.fetch_add(1, std::memory_order_relaxed); }
 
     /**
      * This function simply compares two matrices and display the first
      * unmatching element if there exist one.
+     * Rows are scanned in memory order by several threads, each row being
+     * checked with a branchless loop the compiler vectorizes.
+     * Returns true if both matrices are equal.
      */
-    void compare(Matrix<T>& other) const
+    template<class OtherAllocator>
+    bool compare(const Matrix<T, OtherAllocator>& other) const
     {
-        for (int i = 0; i < getSizeX(); i++) {
-            for (int j = 0; j < getSizeY(); j++) {
+        if (getSizeX() != other.getSizeX() || getSizeY() != other.getSizeY()) {
+            std::cout << "Error in matrix calculation" << std::endl;
+            std::cout << "Sizes differ: " << getSizeX() << "x" << getSizeY() << " and "
+                      << other.getSizeX() << "x" << other.getSizeY() << std::endl;
+            return false;
+        }
+
+        constexpr std::size_t noMismatch = std::numeric_limits<std::size_t>::max();
+        std::atomic<std::size_t> firstMismatchRow{noMismatch};
+
+        std::size_t minRows = minRowsPerThread(sizeX);
+
+        parallelFor(0, sizeY, minRows, [&](std::size_t rowBegin, std::size_t rowEnd) {
+            for (std::size_t y = rowBegin; y < rowEnd; y++) {
+                if (y > firstMismatchRow.load(std::memory_order_relaxed)) {
+                    return;
+                }
+                if (rowMismatches(data() + y * stride(), other.data() + y * other.stride(), sizeX) != 0) {
+                    std::size_t current = firstMismatchRow.load();
+                    while (y < current && !firstMismatchRow.compare_exchange_weak(current, y)) {
+                    }
+                    return;
+                }
+            }
+        });
+
+        std::size_t j = firstMismatchRow.load();
+        if (j != noMismatch) {
+            for (std::size_t i = 0; i < sizeX; i++) {
                 if (this->element(i, j) != other.element(i, j)) {
                     std::cout << "Error in matrix calculation" << std::endl;
                     std::cout << "i= " << i << "j= " << j << "M1(i,j)= " << this->element(i, j)
                               << "M2(i,j)= " << other.element(i, j) << std::endl;
-                    return;
+                    return false;
                 }
             }
         }
         std::cout << "No error in calculus" << std::endl;
+        return true;
     }
 
 protected:
-    std::vector<T> array;
-    int sizeX;
-    int sizeY;
+    static std::size_t rowMismatches(const T* a, const T* b, std::size_t n)
+    {
+        std::size_t mismatches = 0;
+        for (std::size_t x = 0; x < n; x++) {
+            mismatches += a[x] != b[x];
+        }
+        return mismatches;
+    }
+
+    std::vector<T, Allocator> array;
+    std::size_t sizeX;
+    std::size_t sizeY;
+    std::uint64_t id;
+    std::atomic<std::uint64_t> version{0};
 };
 
 /**
  * A square matrix is simply a matrix with the same size for
  * both rows and columns.
  */
-template<class T>
-class SquareMatrix : public Matrix<T>
+template<class T, class Allocator = MatrixAllocator<T>>
+class SquareMatrix : public Matrix<T, Allocator>
 {
 public:
-    SquareMatrix(int size) : Matrix<T>(size, size) {}
+    SquareMatrix(std::size_t size) : Matrix<T, Allocator>(size, size) {}
 
-    int size() const
+    std::size_t size() const
     {
         return this->sizeX;
     }
@@ -0,0 +1,135 @@
+#ifndef MATRIXALLOCATOR_H
+#define MATRIXALLOCATOR_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include <sys/mman.h>
+
+///
+/// Huge page policy used by MatrixAllocator for large allocations.
+///
+enum class HugePages
+{
+    None,        // plain aligned heap allocation
+    Transparent, // mmap + madvise(MADV_HUGEPAGE), the kernel promotes when it can
+    Explicit     // mmap(MAP_HUGETLB) from the reserved pool, falls back to Transparent
+};
+
+///
+/// Allocator used for the storage of Matrix<T>.
+///
+/// - every allocation is aligned on \p Alignment bytes (a cache line by default),
+/// - allocations of at least hugePageSize bytes are mapped directly and backed by
+///   huge pages according to \p Policy, which avoids 4K TLB misses on large matrices,
+/// - elements are default-initialised instead of value-initialised, so building a
+///   matrix of scalars does not zero it: pages are only touched when the matrix is
+///   first written, ideally by the thread that will later work on them.
+///
+template<class T, std::size_t Alignment = 64, HugePages Policy = HugePages::Transparent>
+class MatrixAllocator
+{
+    static_assert((Alignment & (Alignment - 1)) == 0, "Alignment must be a power of two");
+
+public:
+    using value_type = T;
+
+    static constexpr std::size_t hugePageSize = 2 * 1024 * 1024;
+
+    template<class U>
+    struct rebind
+    {
+        using other = MatrixAllocator<U, Alignment, Policy>;
+    };
+
+    MatrixAllocator() noexcept = default;
+
+    template<class U>
+    MatrixAllocator(const MatrixAllocator<U, Alignment, Policy>&) noexcept {}
+
+    T* allocate(std::size_t n)
+    {
+        std::size_t bytes = n * sizeof(T);
+        if (usesMapping(bytes)) {
+            void* p = map(roundToHugePage(bytes));
+            if (p == nullptr) {
+                throw std::bad_alloc();
+            }
+            return static_cast<T*>(p);
+        }
+        return static_cast<T*>(::operator new(bytes, std::align_val_t(alignment())));
+    }
+
+    void deallocate(T* p, std::size_t n) noexcept
+    {
+        std::size_t bytes = n * sizeof(T);
+        if (usesMapping(bytes)) {
+            munmap(p, roundToHugePage(bytes));
+            return;
+        }
+        ::operator delete(p, std::align_val_t(alignment()));
+    }
+
+    ///
+    /// \brief default-initialises the element, leaving scalars uninitialised
+    ///
+    template<class U>
+    void construct(U* p) noexcept(std::is_nothrow_default_constructible<U>::value)
+    {
+        ::new (static_cast<void*>(p)) U;
+    }
+
+    template<class U, class... Args>
+    void construct(U* p, Args&&... args)
+    {
+        ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...);
+    }
+
+    template<class U>
+    bool operator==(const MatrixAllocator<U, Alignment, Policy>&) const noexcept { return true; }
+
+    template<class U>
+    bool operator!=(const MatrixAllocator<U, Alignment, Policy>&) const noexcept { return false; }
+
+private:
+    static constexpr std::size_t alignment()
+    {
+        return Alignment < alignof(T) ? alignof(T) : Alignment;
+    }
+
+    static constexpr bool usesMapping(std::size_t bytes)
+    {
+        return Policy != HugePages::None && bytes >= hugePageSize;
+    }
+
+    static constexpr std::size_t roundToHugePage(std::size_t bytes)
+    {
+        return (bytes + hugePageSize - 1) / hugePageSize * hugePageSize;
+    }
+
+    static void* map(std::size_t bytes)
+    {
+#ifdef MAP_HUGETLB
+        if (Policy == HugePages::Explicit) {
+            void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (p != MAP_FAILED) {
+                return p;
+            }
+            // no reserved huge pages left, fall back to transparent ones
+        }
+#endif
+        void* p = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (p == MAP_FAILED) {
+            return nullptr;
+        }
+#ifdef MADV_HUGEPAGE
+        madvise(p, bytes, MADV_HUGEPAGE);
+#endif
+        return p;
+    }
+};
+
+#endif // MATRIXALLOCATOR_H
@@ -0,0 +1,222 @@
+#ifndef MATRIXCHAIN_H
+#define MATRIXCHAIN_H
+
+#include <algorithm>
+#include <cstddef>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <vector>
+
+#include "matrix.h"
+#include "threadedmatrixmultiplier.h"
+
+/**
+ * A lazy product of matrices A1 * A2 * ... * An, built with chain(A1) * A2 * ...
+ * Nothing is computed until evaluate():
+ * - the parenthesisation is chosen by dynamic programming over the shapes of the
+ *   matrices, to minimise the number of multiply-adds,
+ * - every product of the resulting tree is cut into tiles, and a tile is handed to
+ *   the worker threads as soon as the tiles it reads are computed, so the stages
+ *   overlap instead of waiting for the whole previous product.
+ *
+ * The matrices are referenced, not copied: they must outlive the chain.
+ * Matrix i has rows(i) rows and rows(i + 1) columns, the columns of each matrix
+ * matching the rows of the next one.
+ */
+template<class T>
+class MatrixChain
+{
+public:
+    explicit MatrixChain(const Matrix<T>& first)
+    {
+        matrices.push_back(&first);
+    }
+
+    MatrixChain& operator*(const Matrix<T>& next)
+    {
+        if (matrices.back()->getSizeX() != next.getSizeY()) {
+            throw std::invalid_argument("Matrix chain: columns of a matrix do not match rows of the next one");
+        }
+        matrices.push_back(&next);
+        return *this;
+    }
+
+    [[nodiscard]] std::size_t length() const { return matrices.size(); }
+
+    [[nodiscard]] std::size_t getSizeX() const { return matrices.back()->getSizeX(); }
+
+    [[nodiscard]] std::size_t getSizeY() const { return matrices.front()->getSizeY(); }
+
+    ///
+    /// \brief number of multiply-adds of the best parenthesisation
+    ///
+    [[nodiscard]] std::size_t optimalCost() const
+    {
+        return solveOrder().cost[0][length() - 1];
+    }
+
+    ///
+    /// \brief evaluate
+    /// \param multiplier Multiplier whose worker threads compute the tiles
+    /// \param result Product of the chain, getSizeX() x getSizeY(), not one of its matrices
+    /// \param tileSize Size of the tiles of every product
+    ///
+    template<class TAcc>
+    void evaluate(ThreadedMatrixMultiplier<T, TAcc, T>& multiplier, Matrix<T>& result, std::size_t tileSize = 64)
+    {
+        if (result.getSizeX() != getSizeX() || result.getSizeY() != getSizeY()) {
+            throw std::invalid_argument("Matrix chain: the result does not have the size of the product");
+        }
+        if (tileSize == 0) {
+            throw std::invalid_argument("Matrix chain: tileSize must be positive");
+        }
+        if (std::find(matrices.begin(), matrices.end(), &result) != matrices.end()) {
+            throw std::invalid_argument("Matrix chain: the result cannot be one of the matrices of the chain");
+        }
+
+        if (length() == 1) {
+            std::copy(matrices[0]->data(), matrices[0]->data() + getSizeX() * getSizeY(), result.data());
+            result.touch();
+            return;
+        }
+
+        Order order = solveOrder();
+        Graph graph;
+        graph.tileSize = tileSize;
+        buildProduct(graph, order, 0, length() - 1, &result);
+
+        multiplier.runTileGraph(graph.tasks);
+        result.touch();
+    }
+
+private:
+    //! Best costs and splits of every sub-chain [i, j]
+    struct Order
+    {
+        std::vector<std::vector<std::size_t>> cost;
+        std::vector<std::vector<std::size_t>> split;
+    };
+
+    //! Operand of a product in the tree: an input, or an intermediate product with its tiles
+    struct Operand
+    {
+        const Matrix<T>* matrix;
+        std::size_t firstTask; // index of its first tile in the graph, tiles being row-major
+        std::size_t nbTileColumns;
+        bool computed; // false for inputs, which are ready from the start
+    };
+
+    struct Graph
+    {
+        std::size_t tileSize;
+        std::vector<std::unique_ptr<TileTask<T, T>>> tasks;
+        std::vector<std::unique_ptr<Matrix<T>>> intermediates;
+    };
+
+    std::size_t rows(std::size_t i) const
+    {
+        return i < length() ? matrices[i]->getSizeY() : matrices.back()->getSizeX();
+    }
+
+    Order solveOrder() const
+    {
+        std::size_t n = length();
+        Order order;
+        order.cost.assign(n, std::vector<std::size_t>(n, 0));
+        order.split.assign(n, std::vector<std::size_t>(n, 0));
+
+        for (std::size_t span = 1; span < n; span++) {
+            for (std::size_t i = 0; i + span < n; i++) {
+                std::size_t j = i + span;
+                order.cost[i][j] = std::numeric_limits<std::size_t>::max();
+                for (std::size_t s = i; s < j; s++) {
+                    std::size_t cost = order.cost[i][s] + order.cost[s + 1][j] + rows(i) * rows(s + 1) * rows(j + 1);
+                    if (cost < order.cost[i][j]) {
+                        order.cost[i][j] = cost;
+                        order.split[i][j] = s;
+                    }
+                }
+            }
+        }
+        return order;
+    }
+
+    ///
+    /// Adds the tiles of the product of [i, j] to the graph, after those of its
+    /// operands, and returns it as an operand. target is where to store it, a new
+    /// intermediate matrix if null.
+    ///
+    Operand buildProduct(Graph& graph, const Order& order, std::size_t i, std::size_t j, Matrix<T>* target)
+    {
+        if (i == j) {
+            return Operand{matrices[i], 0, 0, false};
+        }
+
+        std::size_t s = order.split[i][j];
+        Operand left = buildProduct(graph, order, i, s, nullptr);
+        Operand right = buildProduct(graph, order, s + 1, j, nullptr);
+
+        if (target == nullptr) {
+            graph.intermediates.push_back(std::make_unique<Matrix<T>>(rows(j + 1), rows(i)));
+            target = graph.intermediates.back().get();
+        }
+
+        std::size_t tileSize = graph.tileSize;
+        std::size_t nbTileRows = (target->getSizeY() + tileSize - 1) / tileSize;
+        std::size_t nbTileColumns = (target->getSizeX() + tileSize - 1) / tileSize;
+        std::size_t depth = left.matrix->getSizeX();
+        std::size_t firstTask = graph.tasks.size();
+
+        for (std::size_t ty = 0; ty < nbTileRows; ty++) {
+            for (std::size_t tx = 0; tx < nbTileColumns; tx++) {
+                std::size_t rowBegin = ty * tileSize;
+                std::size_t columnBegin = tx * tileSize;
+
+                auto task = std::make_unique<TileTask<T, T>>();
+                ComputeParameters<T, T>& params = task->params;
+                params.a = left.matrix->data() + rowBegin * left.matrix->stride();
+                params.b = right.matrix->data() + columnBegin;
+                params.c = target->data() + rowBegin * target->stride() + columnBegin;
+                params.strideA = left.matrix->stride();
+                params.strideB = right.matrix->stride();
+                params.strideC = target->stride();
+                params.nbRows = std::min(tileSize, target->getSizeY() - rowBegin);
+                params.rowLength = std::min(tileSize, target->getSizeX() - columnBegin);
+                params.depth = depth;
+
+                // the tile reads the tile row ty of the left operand and the tile column tx of the right one
+                if (left.computed) {
+                    for (std::size_t k = 0; k < left.nbTileColumns; k++) {
+                        graph.tasks[left.firstTask + ty * left.nbTileColumns + k]->dependents.push_back(task.get());
+                        task->nbPendingInputs++;
+                    }
+                }
+                if (right.computed) {
+                    std::size_t nbTileRowsRight = (right.matrix->getSizeY() + tileSize - 1) / tileSize;
+                    for (std::size_t k = 0; k < nbTileRowsRight; k++) {
+                        graph.tasks[right.firstTask + k * right.nbTileColumns + tx]->dependents.push_back(task.get());
+                        task->nbPendingInputs++;
+                    }
+                }
+
+                graph.tasks.push_back(std::move(task));
+            }
+        }
+
+        return Operand{target, firstTask, nbTileColumns, true};
+    }
+
+    std::vector<const Matrix<T>*> matrices;
+};
+
+///
+/// \brief starts a lazy chain of products: chain(A) * B * C
+///
+template<class T>
+MatrixChain<T> chain(const Matrix<T>& first)
+{
+    return MatrixChain<T>(first);
+}
+
+#endif // MATRIXCHAIN_H
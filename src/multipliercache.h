@@ -0,0 +1,242 @@
+#ifndef MULTIPLIERCACHE_H
+#define MULTIPLIERCACHE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <list>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "matrix.h"
+#include "parallelfor.h"
+
+///
+/// Hit and miss counters of the caches of a multiplier.
+///
+struct CacheStatistics
+{
+    std::uint64_t operandHits = 0;
+    std::uint64_t operandMisses = 0;
+    std::uint64_t resultHits = 0;
+    std::uint64_t resultMisses = 0;
+};
+
+
+///
+/// 128 bits hash of the content of a matrix.
+///
+struct ContentHash
+{
+    std::uint64_t low = 0;
+    std::uint64_t high = 0;
+
+    bool operator==(const ContentHash& other) const { return low == other.low && high == other.high; }
+};
+
+namespace multipliercache_detail {
+
+inline std::uint64_t rotl(std::uint64_t x, int r)
+{
+    return (x << r) | (x >> (64 - r));
+}
+
+//! Final avalanche of MurmurHash3
+inline std::uint64_t mix(std::uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+inline ContentHash hashBytes(const unsigned char* bytes, std::size_t length)
+{
+    std::uint64_t h1 = 0x9e3779b97f4a7c15ULL ^ length;
+    std::uint64_t h2 = 0xc2b2ae3d27d4eb4fULL + length;
+
+    std::size_t i = 0;
+    for (; i + 8 <= length; i += 8) {
+        std::uint64_t word;
+        std::memcpy(&word, bytes + i, sizeof(word));
+        h1 = rotl(h1 ^ (word * 0x87c37b91114253d5ULL), 31) * 0x4cf5ad432745937fULL;
+        h2 = rotl(h2 + (word * 0x4cf5ad432745937fULL), 29) * 0x87c37b91114253d5ULL;
+    }
+    std::uint64_t tail = 0;
+    std::memcpy(&tail, bytes + i, length - i);
+    h1 ^= tail;
+    h2 += tail;
+
+    return ContentHash{mix(h1 + h2), mix(h2 ^ rotl(h1, 17))};
+}
+
+} // namespace multipliercache_detail
+
+///
+/// \brief hash of the sizes and elements of M, rows being hashed by several threads
+/// \param forRange Runs its last argument over chunks of rows, as parallelFor
+///
+template<class T, class Allocator, class ForRange>
+ContentHash contentHash(const Matrix<T, Allocator>& M, ForRange forRange)
+{
+    using namespace multipliercache_detail;
+
+    std::size_t rowBytes = M.getSizeX() * sizeof(T);
+    std::vector<ContentHash> rowHashes(M.getSizeY());
+    std::size_t minRows = minRowsPerThread(M.getSizeX());
+    forRange(0, M.getSizeY(), minRows, [&](std::size_t rowBegin, std::size_t rowEnd) {
+        for (std::size_t y = rowBegin; y < rowEnd; y++) {
+            rowHashes[y] = hashBytes(reinterpret_cast<const unsigned char*>(M.data() + y * M.stride()), rowBytes);
+        }
+    });
+
+    ContentHash hash{mix(M.getSizeX()), mix(M.getSizeY() ^ 0x9e3779b97f4a7c15ULL)};
+    for (const ContentHash& rowHash : rowHashes) {
+        hash.low = mix(hash.low * 0x87c37b91114253d5ULL + rowHash.low);
+        hash.high = mix(hash.high * 0x4cf5ad432745937fULL + rowHash.high);
+    }
+    return hash;
+}
+
+///
+/// \brief hash of the sizes and elements of M, rows being hashed by parallelFor
+///
+template<class T, class Allocator>
+ContentHash contentHash(const Matrix<T, Allocator>& M)
+{
+    return contentHash(M, [](std::size_t begin, std::size_t end, std::size_t minChunk, auto f) {
+        parallelFor(begin, end, minChunk, f);
+    });
+}
+
+
+///
+/// A least recently used cache of shared, immutable values, bounded by the sum of
+/// the sizes (in bytes) of its values. It is not synchronised, its owner locks it.
+/// A budget of 0 disables the cache.
+///
+template<class Key, class Value, class KeyHash>
+class LruCache
+{
+public:
+    using ValuePtr = std::shared_ptr<const Value>;
+
+    void setBudget(std::size_t budgetBytes)
+    {
+        budget = budgetBytes;
+        evict();
+    }
+
+    [[nodiscard]] bool isEnabled() const { return budget > 0; }
+
+    //! The value of key, or null. A found value becomes the most recently used.
+    ValuePtr get(const Key& key)
+    {
+        auto found = index.find(key);
+        if (found == index.end()) {
+            return nullptr;
+        }
+        entries.splice(entries.begin(), entries, found->second);
+        return found->second->value;
+    }
+
+    //! Stores value, evicting the least recently used ones to stay within the budget
+    void put(const Key& key, ValuePtr value, std::size_t bytes)
+    {
+        if (bytes > budget) {
+            return;
+        }
+        auto found = index.find(key);
+        if (found != index.end()) {
+            usedBytes -= found->second->bytes;
+            entries.erase(found->second);
+            index.erase(found);
+        }
+        entries.push_front(Entry{key, std::move(value), bytes});
+        index[key] = entries.begin();
+        usedBytes += bytes;
+        evict();
+    }
+
+    [[nodiscard]] std::size_t getUsedBytes() const { return usedBytes; }
+
+private:
+    struct Entry
+    {
+        Key key;
+        ValuePtr value;
+        std::size_t bytes;
+    };
+
+    void evict()
+    {
+        while (usedBytes > budget && !entries.empty()) {
+            usedBytes -= entries.back().bytes;
+            index.erase(entries.back().key);
+            entries.pop_back();
+        }
+    }
+
+    std::size_t budget = 0;
+    std::size_t usedBytes = 0;
+    std::list<Entry> entries;
+    std::unordered_map<Key, typename std::list<Entry>::iterator, KeyHash> index;
+};
+
+
+///
+/// Key of a packed operand: the matrix as it was at a given version, packed in
+/// blocks of a given size.
+///
+struct PackedOperandKey
+{
+    std::uint64_t id;
+    std::uint64_t version;
+    std::size_t blockSize;
+
+    bool operator==(const PackedOperandKey& other) const
+    {
+        return id == other.id && version == other.version && blockSize == other.blockSize;
+    }
+};
+
+struct PackedOperandKeyHash
+{
+    std::size_t operator()(const PackedOperandKey& key) const
+    {
+        using multipliercache_detail::mix;
+        return mix(key.id ^ mix(key.version ^ mix(key.blockSize)));
+    }
+};
+
+
+///
+/// Key of a cached result: the contents of both operands and the block size,
+/// which decides the order of the sums for floating point types.
+///
+struct ResultKey
+{
+    ContentHash a;
+    ContentHash b;
+    std::size_t blockSize;
+
+    bool operator==(const ResultKey& other) const
+    {
+        return a == other.a && b == other.b && blockSize == other.blockSize;
+    }
+};
+
+struct ResultKeyHash
+{
+    std::size_t operator()(const ResultKey& key) const
+    {
+        using multipliercache_detail::mix;
+        return mix(key.a.low ^ mix(key.b.low ^ mix(key.blockSize)));
+    }
+};
+
+#endif // MULTIPLIERCACHE_H
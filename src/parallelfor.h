@@ -0,0 +1,60 @@
+#ifndef PARALLELFOR_H
+#define PARALLELFOR_H
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include <pcosynchro/pcothread.h>
+
+///
+/// \brief runs f(chunkBegin, chunkEnd) over contiguous chunks of [begin, end)
+/// \param begin first index
+/// \param end one past the last index
+/// \param minChunk minimal number of indices handed to a thread
+/// \param f function called once per chunk
+///
+/// The chunks are processed by up to hardware_concurrency() threads, the calling
+/// thread taking the first one. Ranges shorter than two chunks run inline.
+///
+template<class Function>
+void parallelFor(std::size_t begin, std::size_t end, std::size_t minChunk, Function f)
+{
+    if (end <= begin) {
+        return;
+    }
+
+    std::size_t count = end - begin;
+    std::size_t nbChunks = std::max<std::size_t>(1, std::thread::hardware_concurrency());
+    nbChunks = std::min(nbChunks, count / std::max<std::size_t>(1, minChunk));
+    if (nbChunks <= 1) {
+        f(begin, end);
+        return;
+    }
+
+    std::vector<std::unique_ptr<PcoThread>> threads;
+    for (std::size_t chunk = 1; chunk < nbChunks; chunk++) {
+        std::size_t chunkBegin = begin + chunk * count / nbChunks;
+        std::size_t chunkEnd = begin + (chunk + 1) * count / nbChunks;
+        threads.push_back(std::make_unique<PcoThread>([&f, chunkBegin, chunkEnd]() { f(chunkBegin, chunkEnd); }));
+    }
+
+    f(begin, begin + count / nbChunks);
+
+    for (auto& thread : threads) {
+        thread->join();
+    }
+}
+
+///
+/// \brief minimal number of rows of rowLength elements to give a thread: at least
+/// 64K elements, below that threads cost more than they bring
+///
+inline std::size_t minRowsPerThread(std::size_t rowLength)
+{
+    return 1 + (std::size_t(1) << 16) / (rowLength + 1);
+}
+
+#endif // PARALLELFOR_H
@@ -1,24 +1,36 @@
 #ifndef SIMPLEMATRIXMULTIPLIER_H
 #define SIMPLEMATRIXMULTIPLIER_H
 
+#include <vector>
+
 #include "abstractmatrixmultiplier.h"
+#include "dotproduct.h"
 
 /**
  * A simple implementation of the matrix multiplication.
+ * B is first transposed so that every element of C is the dot product of
+ * two contiguous rows, accumulated in TAcc.
  */
-template<class T>
-class SimpleMatrixMultiplier : public AbstractMatrixMultiplier<T>
+template<class TIn, class TAcc = TIn, class TOut = TAcc>
+class SimpleMatrixMultiplier : public AbstractMatrixMultiplier<TIn, TAcc, TOut>
 {
 public:
-    void multiply(const SquareMatrix<T>& A, const SquareMatrix<T>& B, SquareMatrix<T>& C) override
+    void multiply(const SquareMatrix<TIn>& A, const SquareMatrix<TIn>& B, SquareMatrix<TOut>& C) override
     {
-        for (int i = 0; i < A.size(); i++) {
-            for (int j = 0; j < A.size(); j++) {
-                T result = 0.0;
-                for (int k = 0; k < A.size(); k++) {
-                    result += A.element(k, j) * B.element(i, k);
-                }
-                C.setElement(i, j, result);
+        std::size_t n = A.size();
+
+        // Bt row i is column i of B
+        std::vector<TIn> Bt(n * n);
+        for (std::size_t k = 0; k < n; k++) {
+            for (std::size_t i = 0; i < n; i++) {
+                Bt[i * n + k] = B.element(i, k);
+            }
+        }
+
+        for (std::size_t j = 0; j < A.size(); j++) {
+            for (std::size_t i = 0; i < A.size(); i++) {
+                TAcc result = dotProduct<TAcc>(A.data() + j * A.stride(), Bt.data() + i * n, n);
+                C.setElement(i, j, static_cast<TOut>(result));
             }
         }
     }
@@ -0,0 +1,177 @@
+#ifndef SPARSEMATRIX_H
+#define SPARSEMATRIX_H
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <vector>
+
+#include "matrix.h"
+
+/**
+ * A sparse matrix in compressed sparse row (CSR) format.
+ * The non zero elements of row y are values[rowOffsets[y] .. rowOffsets[y + 1]),
+ * their columns being at the same positions in columns.
+ */
+template<class T>
+class CsrMatrix
+{
+public:
+    ///
+    /// \brief builds the CSR form of a dense matrix, dropping its zeros
+    ///
+    template<class Allocator>
+    explicit CsrMatrix(const Matrix<T, Allocator>& dense)
+        : sizeX(dense.getSizeX()), sizeY(dense.getSizeY()), rowOffsets(dense.getSizeY() + 1, 0)
+    {
+        for (std::size_t y = 0; y < sizeY; y++) {
+            const T* row = dense.data() + y * dense.stride();
+            for (std::size_t x = 0; x < sizeX; x++) {
+                if (row[x] != T(0)) {
+                    columns.push_back(x);
+                    values.push_back(row[x]);
+                }
+            }
+            rowOffsets[y + 1] = values.size();
+        }
+    }
+
+    //! Writes the matrix, zeros included, in dense
+    template<class Allocator>
+    void toDense(Matrix<T, Allocator>& dense) const
+    {
+        for (std::size_t y = 0; y < sizeY; y++) {
+            T* row = dense.data() + y * dense.stride();
+            std::fill(row, row + sizeX, T(0));
+            for (std::size_t e = rowOffsets[y]; e < rowOffsets[y + 1]; e++) {
+                row[columns[e]] = values[e];
+            }
+        }
+    }
+
+    [[nodiscard]] std::size_t getSizeX() const { return sizeX; }
+
+    [[nodiscard]] std::size_t getSizeY() const { return sizeY; }
+
+    [[nodiscard]] std::size_t nbNonZeros() const { return values.size(); }
+
+    [[nodiscard]] double density() const
+    {
+        return sizeX * sizeY == 0 ? 0.0 : static_cast<double>(values.size()) / static_cast<double>(sizeX * sizeY);
+    }
+
+    const std::size_t* getRowOffsets() const { return rowOffsets.data(); }
+
+    const std::size_t* getColumns() const { return columns.data(); }
+
+    const T* getValues() const { return values.data(); }
+
+protected:
+    std::size_t sizeX;
+    std::size_t sizeY;
+    std::vector<std::size_t> rowOffsets;
+    std::vector<std::size_t> columns;
+    std::vector<T> values;
+};
+
+
+/**
+ * A sparse matrix in block compressed sparse row (BSR) format: the matrix is cut
+ * into square blocks of blockSize, and only the blocks holding at least one non
+ * zero element are stored, in dense and row-major.
+ * The non empty blocks of block row by are blocks blockRowOffsets[by] ..
+ * blockRowOffsets[by + 1], block e starting at getBlock(e) and being in block
+ * column blockColumns[e].
+ */
+template<class T>
+class BsrMatrix
+{
+public:
+    ///
+    /// \brief builds the BSR form of a dense matrix, dropping its empty blocks
+    /// \param dense Matrix to compress
+    /// \param blockSize Size of the blocks, must divide both sizes of dense
+    ///
+    template<class Allocator>
+    BsrMatrix(const Matrix<T, Allocator>& dense, std::size_t blockSize)
+        : sizeX(dense.getSizeX()), sizeY(dense.getSizeY()), blockSize(blockSize)
+    {
+        if (blockSize == 0 || sizeX % blockSize != 0 || sizeY % blockSize != 0) {
+            throw std::invalid_argument("blockSize must divide the size of the matrix");
+        }
+
+        std::size_t nbBlockRows = sizeY / blockSize;
+        std::size_t nbBlockColumns = sizeX / blockSize;
+        blockRowOffsets.assign(nbBlockRows + 1, 0);
+
+        for (std::size_t by = 0; by < nbBlockRows; by++) {
+            for (std::size_t bx = 0; bx < nbBlockColumns; bx++) {
+                const T* block = dense.data() + by * blockSize * dense.stride() + bx * blockSize;
+                if (!isEmpty(block, dense.stride())) {
+                    blockColumns.push_back(bx);
+                    for (std::size_t y = 0; y < blockSize; y++) {
+                        const T* row = block + y * dense.stride();
+                        values.insert(values.end(), row, row + blockSize);
+                    }
+                }
+            }
+            blockRowOffsets[by + 1] = blockColumns.size();
+        }
+    }
+
+    //! Writes the matrix, zeros included, in dense
+    template<class Allocator>
+    void toDense(Matrix<T, Allocator>& dense) const
+    {
+        for (std::size_t y = 0; y < sizeY; y++) {
+            std::fill(dense.data() + y * dense.stride(), dense.data() + y * dense.stride() + sizeX, T(0));
+        }
+        for (std::size_t by = 0; by + 1 < blockRowOffsets.size(); by++) {
+            for (std::size_t e = blockRowOffsets[by]; e < blockRowOffsets[by + 1]; e++) {
+                T* block = dense.data() + by * blockSize * dense.stride() + blockColumns[e] * blockSize;
+                for (std::size_t y = 0; y < blockSize; y++) {
+                    std::copy(getBlock(e) + y * blockSize, getBlock(e) + (y + 1) * blockSize, block + y * dense.stride());
+                }
+            }
+        }
+    }
+
+    [[nodiscard]] std::size_t getSizeX() const { return sizeX; }
+
+    [[nodiscard]] std::size_t getSizeY() const { return sizeY; }
+
+    [[nodiscard]] std::size_t getBlockSize() const { return blockSize; }
+
+    [[nodiscard]] std::size_t nbBlockRows() const { return blockRowOffsets.size() - 1; }
+
+    [[nodiscard]] std::size_t nbBlocks() const { return blockColumns.size(); }
+
+    const std::size_t* getBlockRowOffsets() const { return blockRowOffsets.data(); }
+
+    const std::size_t* getBlockColumns() const { return blockColumns.data(); }
+
+    //! First element of stored block e, its rows being blockSize apart
+    const T* getBlock(std::size_t e) const { return values.data() + e * blockSize * blockSize; }
+
+protected:
+    bool isEmpty(const T* block, std::size_t stride) const
+    {
+        for (std::size_t y = 0; y < blockSize; y++) {
+            for (std::size_t x = 0; x < blockSize; x++) {
+                if (block[y * stride + x] != T(0)) {
+                    return false;
+                }
+            }
+        }
+        return true;
+    }
+
+    std::size_t sizeX;
+    std::size_t sizeY;
+    std::size_t blockSize;
+    std::vector<std::size_t> blockRowOffsets;
+    std::vector<std::size_t> blockColumns;
+    std::vector<T> values;
+};
+
+#endif // SPARSEMATRIX_H
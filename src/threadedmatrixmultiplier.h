@@ -1,7 +1,11 @@
 #ifndef THREADEDMATRIXMULTIPLIER_H
 #define THREADEDMATRIXMULTIPLIER_H
 
+#include <algorithm>
+#include <functional>
+#include <memory>
 #include <queue>
+#include <stdexcept>
 #include <vector>
 
 #include <pcosynchro/pcoconditionvariable.h>
@@ -11,31 +15,89 @@
 #include <pcosynchro/pcothread.h>
 
 #include "abstractmatrixmultiplier.h"
+#include "dotproduct.h"
 #include "matrix.h"
+#include "multipliercache.h"
+#include "sparsematrix.h"
+
+
+///
+/// Kind of work a job asks a worker thread to do.
+///
+enum class JobType
+{
+	Multiply,       // accumulate the product of an A block and a B block into C
+	MultiplySparse, // same, walking only the non zero elements of the A block
+	MultiplyCsr,    // compute rows [rowBegin, rowEnd) of C from a CSR matrix A
+	MultiplyTile,   // compute a tile of C completely, as a task of a tile graph
+	Fill,           // write fillValue in rows [rowBegin, rowEnd) of C
+	Range           // call range(rowBegin, rowEnd), a chunk of a pass over the operands
+};
+
+
+template<class TIn, class TOut>
+class TileTask;
 
 
 ///
 /// A class that holds the necessary parameters for a thread to do a job.
 ///
-template<class T>
+/// The blocks of a product are given by their first element and the number of
+/// elements between two of their rows, so that they can come from a dense
+/// matrix as well as from a BSR one.
+///
+template<class TIn, class TOut = TIn>
 class ComputeParameters
 {
 public:
-    const SquareMatrix<T>* A;
-    const SquareMatrix<T>* B;
-    SquareMatrix<T>* C;
-
-	int blockI; // block row index in C matrix
-	int blockJ; // block column index in C matrix
-	int blockK; // block index for the sum
-	int blockSize; // (one dimension)
+    JobType type = JobType::Multiply;
+
+	const TIn* a; // first element of the A block
+	const TIn* b; // first element of the B block
+	TOut* c; // first element of the C block
+	std::size_t strideA;
+	std::size_t strideB;
+	std::size_t strideC;
+	std::size_t blockSize; // (one dimension)
 	int jobId;
+
+	const TIn* packedB = nullptr; // B block already packed transposed, if cached (Multiply jobs)
+
+	const CsrMatrix<TIn>* sparseA; // A of MultiplyCsr jobs
+	std::size_t rowBegin; // first row to fill or compute (Fill and MultiplyCsr jobs)
+	std::size_t rowEnd; // one past the last row (Fill and MultiplyCsr jobs)
+	std::size_t rowLength; // number of elements in a row of C (Fill, MultiplyCsr and MultiplyTile jobs)
+	TOut fillValue;
+
+	TileTask<TIn, TOut>* task; // task of MultiplyTile jobs
+	const std::function<void(std::size_t, std::size_t)>* range; // function of Range jobs
+	std::size_t nbRows; // number of rows of the tile (MultiplyTile jobs)
+	std::size_t depth; // length of the sums, columns of A and rows of B (MultiplyTile jobs)
+};
+
+
+///
+/// A job in a graph of tiles, where the result of some jobs is read by others.
+/// The job is only sent once all the tasks it depends on are finished, at which
+/// point it can start without waiting for the rest of their computation.
+///
+template<class TIn, class TOut = TIn>
+class TileTask
+{
+public:
+    ComputeParameters<TIn, TOut> params;
+
+    //! Tasks this one still waits for, updated within the buffer monitor
+    int nbPendingInputs = 0;
+
+    //! Tasks waiting for this one
+    std::vector<TileTask*> dependents;
 };
 
 
 /// Buffer class for job distribution using Hoare monitor
 ///
-template<class T>
+template<class TIn, class TOut = TIn>
 class Buffer : public PcoHoareMonitor
 {
 public:
@@ -45,7 +107,7 @@ public:
     /// \brief sends a job to the buffer
     /// \param params reference to a ComputeParameters object
     ///
-    void sendJob(ComputeParameters<T> params) {
+    void sendJob(ComputeParameters<TIn, TOut> params) {
 		monitorIn();
 		jobs.push(params);
 		signal(jobAvailable);
@@ -57,7 +119,7 @@ public:
     /// \param parameters reference to a ComputeParameters object
     /// \return true if a job is available, false otherwise
     ///
-    bool getJob(ComputeParameters<T>& parameters) { 
+    bool getJob(ComputeParameters<TIn, TOut>& parameters) { 
 		monitorIn();
 		while (jobs.empty() && !shouldTerminate) {
 			wait(jobAvailable);
@@ -104,7 +166,29 @@ public:
 		if (idx < remainingJobs.size() && remainingJobs[jobId] > 0) {
 			remainingJobs[jobId]--;
 			if (remainingJobs[jobId] == 0) {
-				signal(jobCompletionCond);
+				// waiters of other computations share the condition, wake them
+				// all so that the one waiting for this jobId gets to see it
+				int nbWaiting = nbWaitingCompletion;
+				for (int i = 0; i < nbWaiting; i++) {
+					signal(jobCompletionCond);
+				}
+			}
+		}
+		monitorOut();
+	}
+
+	///
+	/// \brief notifies that a task of a tile graph has been finished and sends
+	/// the tasks that were only waiting for this one
+	/// \param task the finished task
+	///
+	void notifyTaskFinished(TileTask<TIn, TOut>* task) {
+		monitorIn();
+		for (TileTask<TIn, TOut>* dependent : task->dependents) {
+			dependent->nbPendingInputs--;
+			if (dependent->nbPendingInputs == 0) {
+				jobs.push(dependent->params);
+				signal(jobAvailable);
 			}
 		}
 		monitorOut();
@@ -117,7 +201,9 @@ public:
 	void waitForCompletion(int jobId) {
 		monitorIn();
 		while (remainingJobs[jobId] > 0) {
+			nbWaitingCompletion++;
 			wait(jobCompletionCond);
+			nbWaitingCompletion--;
 		}
 		monitorOut();
 	}
@@ -153,11 +239,12 @@ public:
 	}
 
 private:
-	std::queue<ComputeParameters<T>> jobs;
+	std::queue<ComputeParameters<TIn, TOut>> jobs;
 	Condition jobAvailable;
 
 	Condition jobCompletionCond;
 	std::vector<int> remainingJobs;
+	int nbWaitingCompletion = 0;
 
 	int nextJobId = 0;
 	bool shouldTerminate = false;
@@ -168,50 +255,325 @@ private:
 /// A multi-threaded multiplicator. multiply() should at least be reentrant.
 /// It is up to you to offer a very good parallelism.
 ///
-template<class T>
-class ThreadedMatrixMultiplier : public AbstractMatrixMultiplier<T>
+/// Inputs are TIn, each block product is summed in TAcc, then added to the
+/// result in TOut, going through TAcc. TOut should thus be at least as precise
+/// as TAcc, the partial sums of the k blocks being combined in it.
+///
+/// Sparse inputs are handled per block: the (i,j,k) jobs whose A or B block is
+/// empty are not created at all, and the A blocks whose density is below the
+/// sparsity threshold are multiplied by walking their non zero elements only.
+///
+template<class TIn, class TAcc = TIn, class TOut = TAcc>
+class ThreadedMatrixMultiplier : public AbstractMatrixMultiplier<TIn, TAcc, TOut>
 {
 private:
 
-	template<class S>
-	static void workerThreadFunction(ThreadedMatrixMultiplier<S>* multiplier) {
-		ComputeParameters<S> params;
+	static void workerThreadFunction(ThreadedMatrixMultiplier* multiplier) {
+		ComputeParameters<TIn, TOut> params;
 		while(multiplier->buf.getJob(params)) {
-			// calculate block boundaries
-			int startI = params.blockI * params.blockSize;
-			int endI = startI + params.blockSize;
-			int startJ = params.blockJ * params.blockSize;
-			int endJ = startJ + params.blockSize;
-			int startK = params.blockK * params.blockSize;
-			int endK = startK + params.blockSize;
-
-			// compute partial sum for this (i,j,k) block
-			// multiple k-blocks contribute to same C[i][j], so we batch updates
-			std::vector<std::vector<S>> partialSums(endI - startI, std::vector<S>(endJ - startJ, S(0)));
-			for (int i = startI; i < endI; i++) {
-				for (int j = startJ; j < endJ; j++) {
-					for (int k = startK; k < endK; k++) {
-						partialSums[i - startI][j - startJ] += params.A->element(k, j) * params.B->element(i, k);
+			switch (params.type) {
+			case JobType::Fill:
+				fillRows(params);
+				break;
+			case JobType::Range:
+				(*params.range)(params.rowBegin, params.rowEnd);
+				break;
+			case JobType::MultiplyCsr:
+				multiplyCsrRows(params);
+				break;
+			case JobType::MultiplyTile:
+				multiplyTile(params);
+				multiplier->buf.notifyTaskFinished(params.task);
+				break;
+			case JobType::Multiply:
+			case JobType::MultiplySparse:
+				multiplier->multiplyBlock(params);
+				break;
+			}
+			multiplier->buf.notifyJobFinished(params.jobId);
+		}
+	}
+
+	static void fillRows(const ComputeParameters<TIn, TOut>& params) {
+		for (std::size_t j = params.rowBegin; j < params.rowEnd; j++) {
+			TOut* cRow = params.c + j * params.strideC;
+			std::fill(cRow, cRow + params.rowLength, params.fillValue);
+		}
+	}
+
+	///
+	/// C block += A block * B block
+	///
+	void multiplyBlock(const ComputeParameters<TIn, TOut>& params) {
+		std::size_t blockSize = params.blockSize;
+
+		// compute partial sum for this (i,j,k) block
+		// multiple k-blocks contribute to same C[i][j], so we batch updates
+		std::vector<TAcc> partialSums(blockSize * blockSize);
+
+		if (params.type == JobType::MultiplySparse) {
+			// C(., j) += A(k, j) * B(., k) for the non zero A(k, j) only
+			std::fill(partialSums.begin(), partialSums.end(), TAcc(0));
+			for (std::size_t j = 0; j < blockSize; j++) {
+				const TIn* aRow = params.a + j * params.strideA;
+				TAcc* sumRow = partialSums.data() + j * blockSize;
+				for (std::size_t k = 0; k < blockSize; k++) {
+					if (aRow[k] == TIn(0)) {
+						continue;
+					}
+					TAcc aValue = static_cast<TAcc>(aRow[k]);
+					const TIn* bRow = params.b + k * params.strideB;
+					for (std::size_t i = 0; i < blockSize; i++) {
+						sumRow[i] += aValue * static_cast<TAcc>(bRow[i]);
 					}
 				}
 			}
-			
-			// accumulate partial sums into result matric
-			// we need mutex here because multiple threads are going to write to
-			// the same result matrix
-			multiplier->resultMutex.lock();
-			for (int i = startI; i < endI; i++) {
-				for (int j = startJ; j < endJ; j++) {
-					S current = params.C->element(i, j);
-					params.C->setElement(i, j, current + partialSums[i - startI][j - startJ]);
+		}
+		else {
+			// the B block packed transposed, so that C(i, j) is the dot product of
+			// two contiguous rows: A(., j) and Bt(., i)
+			std::vector<TIn> localPackedB;
+			const TIn* packedB = params.packedB;
+			if (packedB == nullptr) {
+				localPackedB.resize(blockSize * blockSize);
+				packBlock(params.b, params.strideB, blockSize, localPackedB.data());
+				packedB = localPackedB.data();
+			}
+
+			for (std::size_t j = 0; j < blockSize; j++) {
+				const TIn* aRow = params.a + j * params.strideA;
+				TAcc* sumRow = partialSums.data() + j * blockSize;
+				for (std::size_t i = 0; i < blockSize; i++) {
+					sumRow[i] = dotProduct<TAcc>(aRow, packedB + i * blockSize, blockSize);
 				}
 			}
-			multiplier->resultMutex.unlock();
+		}
 
-			multiplier->buf.notifyJobFinished(params.jobId);
+		// accumulate partial sums into result matric
+		// we need mutex here because multiple threads are going to write to
+		// the same result matrix
+		resultMutex.lock();
+		for (std::size_t j = 0; j < blockSize; j++) {
+			TOut* cRow = params.c + j * params.strideC;
+			const TAcc* sumRow = partialSums.data() + j * blockSize;
+			for (std::size_t i = 0; i < blockSize; i++) {
+				cRow[i] = static_cast<TOut>(static_cast<TAcc>(cRow[i]) + sumRow[i]);
+			}
+		}
+		resultMutex.unlock();
+	}
+
+	//! packed(i, k) = B(i, k) for a block of B, packed row i being column i of the block
+	static void packBlock(const TIn* b, std::size_t strideB, std::size_t blockSize, TIn* packed) {
+		for (std::size_t k = 0; k < blockSize; k++) {
+			const TIn* bRow = b + k * strideB;
+			for (std::size_t i = 0; i < blockSize; i++) {
+				packed[i * blockSize + k] = bRow[i];
+			}
+		}
+	}
+
+	///
+	/// B packed block by block, block (i, k) starting at (k * nbBlocks + i) * blockSize^2,
+	/// taken from the operand cache when B did not change since it was packed.
+	/// Null when the operand cache is disabled.
+	///
+	std::shared_ptr<const std::vector<TIn>> packedOperand(const SquareMatrix<TIn>& B, std::size_t blockSize) {
+		PackedOperandKey key{B.getId(), B.getVersion(), blockSize};
+
+		cacheMutex.lock();
+		if (!operandCache.isEnabled()) {
+			cacheMutex.unlock();
+			return nullptr;
+		}
+		auto packed = operandCache.get(key);
+		if (packed) {
+			statistics.operandHits++;
+		}
+		else {
+			statistics.operandMisses++;
+		}
+		cacheMutex.unlock();
+
+		if (packed) {
+			return packed;
+		}
+
+		std::size_t nbBlocks = B.size() / blockSize;
+		auto newPacked = std::make_shared<std::vector<TIn>>(B.size() * B.size());
+		forRangeOnWorkers(0, nbBlocks, 1, [&](std::size_t blockRowBegin, std::size_t blockRowEnd) {
+			for (std::size_t k = blockRowBegin; k < blockRowEnd; k++) {
+				for (std::size_t i = 0; i < nbBlocks; i++) {
+					packBlock(B.data() + k * blockSize * B.stride() + i * blockSize, B.stride(), blockSize,
+					          newPacked->data() + (k * nbBlocks + i) * blockSize * blockSize);
+				}
+			}
+		});
+
+		cacheMutex.lock();
+		operandCache.put(key, newPacked, newPacked->size() * sizeof(TIn));
+		cacheMutex.unlock();
+		return newPacked;
+	}
+
+	//! Copies the cached result of key in C, returns false if there is none
+	bool lookupResult(const ResultKey& key, SquareMatrix<TOut>& C) {
+		cacheMutex.lock();
+		auto result = resultCache.get(key);
+		if (result) {
+			statistics.resultHits++;
+		}
+		else {
+			statistics.resultMisses++;
+		}
+		cacheMutex.unlock();
+
+		if (!result) {
+			return false;
+		}
+		std::copy(result->begin(), result->end(), C.data());
+		C.touch();
+		return true;
+	}
+
+	void storeResult(const ResultKey& key, const SquareMatrix<TOut>& C) {
+		auto result = std::make_shared<std::vector<TOut>>(C.data(), C.data() + C.size() * C.size());
+		cacheMutex.lock();
+		resultCache.put(key, result, result->size() * sizeof(TOut));
+		cacheMutex.unlock();
+	}
+
+	///
+	/// Rows [rowBegin, rowEnd) of C = A * B, A being in CSR: row j of C is the sum of
+	/// the rows k of B weighted by the non zero A(k, j). The rows belong to this job
+	/// only, so they are written without locking.
+	///
+	static void multiplyCsrRows(const ComputeParameters<TIn, TOut>& params) {
+		const std::size_t* rowOffsets = params.sparseA->getRowOffsets();
+		const std::size_t* columns = params.sparseA->getColumns();
+		const TIn* values = params.sparseA->getValues();
+
+		std::vector<TAcc> sumRow(params.rowLength);
+		for (std::size_t j = params.rowBegin; j < params.rowEnd; j++) {
+			std::fill(sumRow.begin(), sumRow.end(), TAcc(0));
+			for (std::size_t e = rowOffsets[j]; e < rowOffsets[j + 1]; e++) {
+				TAcc aValue = static_cast<TAcc>(values[e]);
+				const TIn* bRow = params.b + columns[e] * params.strideB;
+				for (std::size_t i = 0; i < params.rowLength; i++) {
+					sumRow[i] += aValue * static_cast<TAcc>(bRow[i]);
+				}
+			}
+			TOut* cRow = params.c + j * params.strideC;
+			for (std::size_t i = 0; i < params.rowLength; i++) {
+				cRow[i] = static_cast<TOut>(sumRow[i]);
+			}
+		}
+	}
+
+	///
+	/// C tile = A rows * B columns, the whole sum at once. The tile belongs to this
+	/// job only, so it is written without locking.
+	///
+	static void multiplyTile(const ComputeParameters<TIn, TOut>& params) {
+		std::vector<TAcc> sumRow(params.rowLength);
+		for (std::size_t j = 0; j < params.nbRows; j++) {
+			std::fill(sumRow.begin(), sumRow.end(), TAcc(0));
+			const TIn* aRow = params.a + j * params.strideA;
+			for (std::size_t k = 0; k < params.depth; k++) {
+				TAcc aValue = static_cast<TAcc>(aRow[k]);
+				const TIn* bRow = params.b + k * params.strideB;
+				for (std::size_t i = 0; i < params.rowLength; i++) {
+					sumRow[i] += aValue * static_cast<TAcc>(bRow[i]);
+				}
+			}
+			TOut* cRow = params.c + j * params.strideC;
+			for (std::size_t i = 0; i < params.rowLength; i++) {
+				cRow[i] = static_cast<TOut>(sumRow[i]);
+			}
+		}
+	}
+
+	///
+	/// Number of non zero elements in each of the nbBlocksPerRow^2 blocks of M,
+	/// block (x, y) being at y * nbBlocksPerRow + x
+	///
+	std::vector<std::size_t> countNonZerosPerBlock(const SquareMatrix<TIn>& M, std::size_t nbBlocksPerRow) {
+		std::size_t blockSize = M.size() / nbBlocksPerRow;
+		std::vector<std::size_t> counts(nbBlocksPerRow * nbBlocksPerRow, 0);
+		forRangeOnWorkers(0, nbBlocksPerRow, 1, [&](std::size_t blockRowBegin, std::size_t blockRowEnd) {
+			for (std::size_t by = blockRowBegin; by < blockRowEnd; by++) {
+				for (std::size_t y = by * blockSize; y < (by + 1) * blockSize; y++) {
+					const TIn* row = M.data() + y * M.stride();
+					for (std::size_t bx = 0; bx < nbBlocksPerRow; bx++) {
+						std::size_t count = 0;
+						for (std::size_t x = bx * blockSize; x < (bx + 1) * blockSize; x++) {
+							count += row[x] != TIn(0);
+						}
+						counts[by * nbBlocksPerRow + bx] += count;
+					}
+				}
+			}
+		});
+		return counts;
+	}
+
+	//! Kernel for an A block holding nbNonZeros elements
+	JobType blockJobType(std::size_t nbNonZeros, std::size_t blockSize) const {
+		double density = static_cast<double>(nbNonZeros) / static_cast<double>(blockSize * blockSize);
+		return density < sparsityThreshold ? JobType::MultiplySparse : JobType::Multiply;
+	}
+
+	//! Sends all the jobs of one computation and waits for them
+	void runComputation(std::vector<ComputeParameters<TIn, TOut>>& jobs) {
+		int jobId = buf.registerComputation(static_cast<int>(jobs.size()));
+		for (auto& params : jobs) {
+			params.jobId = jobId;
+			buf.sendJob(params);
+		}
+		buf.waitForCompletion(jobId);
+	}
+
+	///
+	/// Calls f over contiguous chunks of [begin, end) of at least minChunk indices, as
+	/// parallelFor, but on the worker threads: the passes over the operands use the
+	/// nbThreads threads of the multiplier instead of starting new ones.
+	///
+	void forRangeOnWorkers(std::size_t begin, std::size_t end, std::size_t minChunk,
+	                       const std::function<void(std::size_t, std::size_t)>& f) {
+		if (end <= begin) {
+			return;
+		}
+		std::size_t count = end - begin;
+		std::size_t nbChunks = std::min<std::size_t>(std::max(1, nbThreads), count / std::max<std::size_t>(1, minChunk));
+		if (nbChunks <= 1) {
+			f(begin, end);
+			return;
+		}
+
+		std::vector<ComputeParameters<TIn, TOut>> jobs;
+		for (std::size_t chunk = 0; chunk < nbChunks; chunk++) {
+			ComputeParameters<TIn, TOut> params;
+			params.type = JobType::Range;
+			params.range = &f;
+			params.rowBegin = begin + chunk * count / nbChunks;
+			params.rowEnd = begin + (chunk + 1) * count / nbChunks;
+			jobs.push_back(params);
+		}
+		runComputation(jobs);
+	}
+
+	//! Throws std::invalid_argument unless A (sizeX x sizeY), B and C all have the same size
+	static void checkSizes(std::size_t sizeX, std::size_t sizeY, std::size_t sizeB, std::size_t sizeC) {
+		if (sizeX != sizeB || sizeY != sizeB || sizeC != sizeB) {
+			throw std::invalid_argument("The sizes of A, B and C must match");
 		}
 	}
 
+	//! Number of row bands for jobs covering whole rows
+	std::size_t nbRowBands(std::size_t size) const {
+		return std::min<std::size_t>(size, std::max(1, nbThreads) * 4);
+	}
+
 public:
     ///
     /// \brief ThreadedMatrixMultiplier
@@ -224,7 +586,7 @@ public:
         : nbThreads(nbThreads), nbBlocksPerRow(nbBlocksPerRow)
     {
 		for (int i = 0; i < nbThreads; i++) {
-			PcoThread* thread = new PcoThread(workerThreadFunction<T>, this);
+			PcoThread* thread = new PcoThread(workerThreadFunction, this);
 			workerThreads.push_back(thread);
 		}
     }
@@ -256,7 +618,7 @@ public:
     /// \param C Result of AxB
     ///
     /// For compatibility reason with SimpleMatrixMultiplier
-    void multiply(const SquareMatrix<T>& A, const SquareMatrix<T>& B, SquareMatrix<T>& C) override
+    void multiply(const SquareMatrix<TIn>& A, const SquareMatrix<TIn>& B, SquareMatrix<TOut>& C) override
     {
         multiply(A, B, C, nbBlocksPerRow);
     }
@@ -270,51 +632,342 @@ public:
     ///
     /// Executes the multithreaded computation, by decomposing the matrices into blocks.
     /// nbBlocksPerRow must divide the size of the matrix.
+    /// The density of every block of A and B is measured first (O(N^2)) to skip the
+    /// empty products and to pick the kernel of each job.
+    /// With the result cache enabled, a product already computed for the same contents
+    /// is copied instead; with the operand cache enabled, B is packed once per version.
     ///
-    void multiply(const SquareMatrix<T>& A, const SquareMatrix<T>& B, SquareMatrix<T>& C, int nbBlocksPerRow)
+    void multiply(const SquareMatrix<TIn>& A, const SquareMatrix<TIn>& B, SquareMatrix<TOut>& C, int nbBlocksPerRow)
     {
 		buf.resetJobCounter();
 		buf.resetTermination();
 
-		int blockSize = A.size() / nbBlocksPerRow;
+		std::size_t nbBlocks = nbBlocksPerRow;
+		std::size_t blockSize = A.size() / nbBlocks;
+
+		cacheMutex.lock();
+		bool useResultCache = resultCache.isEnabled();
+		cacheMutex.unlock();
+
+		ResultKey resultKey{};
+		if (useResultCache) {
+			auto forRange = [this](std::size_t begin, std::size_t end, std::size_t minChunk,
+			                       const std::function<void(std::size_t, std::size_t)>& f) {
+				forRangeOnWorkers(begin, end, minChunk, f);
+			};
+			resultKey = ResultKey{contentHash(A, forRange), contentHash(B, forRange), blockSize};
+			if (lookupResult(resultKey, C)) {
+				return;
+			}
+		}
 		
 		// initialize result matrix C to 0s to make sure it is empty
-		int matrixSize = A.size();
-		for (int i = 0; i < matrixSize; i++) {
-			for (int j = 0; j < matrixSize; j++) {
-				C.setElement(i, j, T(0));
+		fill(C, TOut(0));
+
+		std::vector<std::size_t> nonZerosA = countNonZerosPerBlock(A, nbBlocks);
+		std::vector<std::size_t> nonZerosB = countNonZerosPerBlock(B, nbBlocks);
+
+		// kept alive until the jobs are done, even if evicted meanwhile
+		std::shared_ptr<const std::vector<TIn>> packedB = packedOperand(B, blockSize);
+
+		std::vector<ComputeParameters<TIn, TOut>> jobs;
+		for (std::size_t i = 0; i < nbBlocks; i++) {
+			for (std::size_t j = 0; j < nbBlocks; j++) {
+				for (std::size_t k = 0; k < nbBlocks; k++) {
+					// C(i, j) += A(k, j) * B(i, k), nothing to add if a block is empty
+					std::size_t nonZerosBlockA = nonZerosA[j * nbBlocks + k];
+					if (nonZerosBlockA == 0 || nonZerosB[k * nbBlocks + i] == 0) {
+						continue;
+					}
+
+					ComputeParameters<TIn, TOut> params;
+					params.type = blockJobType(nonZerosBlockA, blockSize);
+					params.blockSize = blockSize;
+					params.a = A.data() + j * blockSize * A.stride() + k * blockSize;
+					params.b = B.data() + k * blockSize * B.stride() + i * blockSize;
+					params.c = C.data() + j * blockSize * C.stride() + i * blockSize;
+					params.strideA = A.stride();
+					params.strideB = B.stride();
+					params.strideC = C.stride();
+					if (packedB) {
+						params.packedB = packedB->data() + (k * nbBlocks + i) * blockSize * blockSize;
+					}
+					jobs.push_back(params);
+				}
 			}
 		}
 
-    	int totalJobs = nbBlocksPerRow * nbBlocksPerRow * nbBlocksPerRow;
-    	int jobId = buf.registerComputation(totalJobs);
+		runComputation(jobs);
+
+		if (useResultCache) {
+			storeResult(resultKey, C);
+		}
+    }
+
+    ///
+    /// \brief multiply
+    /// \param A First matrix, in BSR
+    /// \param B Second matrix
+    /// \param C Result of AxB
+    ///
+    /// Block sparse times dense: one job per stored block of A and block column of C.
+    /// The blocks of A give the decomposition, their size must divide the size of B.
+    ///
+    void multiply(const BsrMatrix<TIn>& A, const SquareMatrix<TIn>& B, SquareMatrix<TOut>& C)
+    {
+		checkSizes(A.getSizeX(), A.getSizeY(), B.size(), C.size());
+		if (B.size() % A.getBlockSize() != 0) {
+			throw std::invalid_argument("The block size of A must divide the size of B");
+		}
+
+		buf.resetJobCounter();
+		buf.resetTermination();
+
+		std::size_t blockSize = A.getBlockSize();
+		std::size_t nbBlocks = B.size() / blockSize;
 
-		for (int i = 0; i < nbBlocksPerRow; i++) {
-			for (int j = 0; j < nbBlocksPerRow; j++) {
-				for (int k = 0; k < nbBlocksPerRow; k++) {
-					ComputeParameters<T> params;
+		fill(C, TOut(0));
+
+		std::vector<ComputeParameters<TIn, TOut>> jobs;
+		for (std::size_t j = 0; j < A.nbBlockRows(); j++) {
+			for (std::size_t e = A.getBlockRowOffsets()[j]; e < A.getBlockRowOffsets()[j + 1]; e++) {
+				std::size_t k = A.getBlockColumns()[e];
+				const TIn* aBlock = A.getBlock(e);
+				std::size_t nonZeros = blockSize * blockSize - std::count(aBlock, aBlock + blockSize * blockSize, TIn(0));
+
+				for (std::size_t i = 0; i < nbBlocks; i++) {
+					ComputeParameters<TIn, TOut> params;
+					params.type = blockJobType(nonZeros, blockSize);
+					params.blockSize = blockSize;
+					params.a = aBlock;
+					params.b = B.data() + k * blockSize * B.stride() + i * blockSize;
+					params.c = C.data() + j * blockSize * C.stride() + i * blockSize;
+					params.strideA = blockSize;
+					params.strideB = B.stride();
+					params.strideC = C.stride();
+					jobs.push_back(params);
+				}
+			}
+		}
+
+		runComputation(jobs);
+    }
+
+    ///
+    /// \brief multiply
+    /// \param A First matrix, in BSR
+    /// \param B Second matrix, in BSR with the same block size
+    /// \param C Result of AxB
+    ///
+    /// Block sparse times block sparse: a job only for each pair of stored blocks
+    /// A(k, j) and B(i, k), which is where the (i,j,k) decomposition does work.
+    ///
+    void multiply(const BsrMatrix<TIn>& A, const BsrMatrix<TIn>& B, SquareMatrix<TOut>& C)
+    {
+		if (B.getSizeX() != B.getSizeY()) {
+			throw std::invalid_argument("B must be square");
+		}
+		checkSizes(A.getSizeX(), A.getSizeY(), B.getSizeX(), C.size());
+		if (B.getBlockSize() != A.getBlockSize()) {
+			throw std::invalid_argument("A and B must have the same block size");
+		}
+
+		buf.resetJobCounter();
+		buf.resetTermination();
+
+		std::size_t blockSize = A.getBlockSize();
+
+		fill(C, TOut(0));
+
+		std::vector<ComputeParameters<TIn, TOut>> jobs;
+		for (std::size_t j = 0; j < A.nbBlockRows(); j++) {
+			for (std::size_t ea = A.getBlockRowOffsets()[j]; ea < A.getBlockRowOffsets()[j + 1]; ea++) {
+				std::size_t k = A.getBlockColumns()[ea];
+				const TIn* aBlock = A.getBlock(ea);
+				std::size_t nonZeros = blockSize * blockSize - std::count(aBlock, aBlock + blockSize * blockSize, TIn(0));
+
+				for (std::size_t eb = B.getBlockRowOffsets()[k]; eb < B.getBlockRowOffsets()[k + 1]; eb++) {
+					std::size_t i = B.getBlockColumns()[eb];
+
+					ComputeParameters<TIn, TOut> params;
+					params.type = blockJobType(nonZeros, blockSize);
 					params.blockSize = blockSize;
-					params.blockI = i;
-					params.blockJ = j;
-					params.blockK = k;
-					params.A = &A;
-					params.B = &B;
-					params.C = &C;
-					params.jobId = jobId;
-					buf.sendJob(params);
+					params.a = aBlock;
+					params.b = B.getBlock(eb);
+					params.c = C.data() + j * blockSize * C.stride() + i * blockSize;
+					params.strideA = blockSize;
+					params.strideB = blockSize;
+					params.strideC = C.stride();
+					jobs.push_back(params);
 				}
 			}
 		}
 
+		runComputation(jobs);
+    }
+
+    ///
+    /// \brief multiply
+    /// \param A First matrix, in CSR
+    /// \param B Second matrix
+    /// \param C Result of AxB
+    ///
+    /// Sparse times dense, row by row (Gustavson): each job computes a band of rows
+    /// of C completely, so C needs neither to be cleared first nor to be locked.
+    ///
+    void multiply(const CsrMatrix<TIn>& A, const SquareMatrix<TIn>& B, SquareMatrix<TOut>& C)
+    {
+		checkSizes(A.getSizeX(), A.getSizeY(), B.size(), C.size());
+
+		buf.resetJobCounter();
+		buf.resetTermination();
+
+		std::size_t size = C.size();
+		std::size_t nbBands = nbRowBands(size);
+
+		std::vector<ComputeParameters<TIn, TOut>> jobs;
+		for (std::size_t band = 0; band < nbBands; band++) {
+			ComputeParameters<TIn, TOut> params;
+			params.type = JobType::MultiplyCsr;
+			params.sparseA = &A;
+			params.b = B.data();
+			params.strideB = B.stride();
+			params.c = C.data();
+			params.strideC = C.stride();
+			params.rowBegin = band * size / nbBands;
+			params.rowEnd = (band + 1) * size / nbBands;
+			params.rowLength = size;
+			jobs.push_back(params);
+		}
+
+		runComputation(jobs);
+		C.touch();
+    }
+
+    ///
+    /// \brief runTileGraph
+    /// \param tasks Tasks of the graph, with their dependencies set
+    ///
+    /// Runs a graph of MultiplyTile jobs: the tasks without pending input are sent
+    /// first, the others as soon as their last input is done. Returns once all the
+    /// tasks are finished. The graph must be acyclic.
+    ///
+    void runTileGraph(std::vector<std::unique_ptr<TileTask<TIn, TOut>>>& tasks)
+    {
+		buf.resetJobCounter();
+		buf.resetTermination();
+
+		int jobId = buf.registerComputation(static_cast<int>(tasks.size()));
+
+		// collect the roots before sending anything, the counters change as soon as a task is done
+		std::vector<TileTask<TIn, TOut>*> roots;
+		for (auto& task : tasks) {
+			task->params.type = JobType::MultiplyTile;
+			task->params.task = task.get();
+			task->params.jobId = jobId;
+			if (task->nbPendingInputs == 0) {
+				roots.push_back(task.get());
+			}
+		}
+		for (TileTask<TIn, TOut>* task : roots) {
+			buf.sendJob(task->params);
+		}
+
 		buf.waitForCompletion(jobId);
     }
 
+    ///
+    /// \brief fill
+    /// \param M Matrix to fill
+    /// \param value Value written in every element of M
+    ///
+    /// Writes value in M with the worker threads, each job covering a band of rows.
+    /// The storage of a new matrix is left uninitialised, so filling it here also makes
+    /// the workers the first ones to touch its pages (parallel first-touch).
+    ///
+    void fill(SquareMatrix<TOut>& M, TOut value)
+    {
+		std::size_t size = M.size();
+		std::size_t nbBands = nbRowBands(size);
+
+		std::vector<ComputeParameters<TIn, TOut>> jobs;
+		for (std::size_t band = 0; band < nbBands; band++) {
+			ComputeParameters<TIn, TOut> params;
+			params.type = JobType::Fill;
+			params.c = M.data();
+			params.strideC = M.stride();
+			params.rowBegin = band * size / nbBands;
+			params.rowEnd = (band + 1) * size / nbBands;
+			params.rowLength = size;
+			params.fillValue = value;
+			jobs.push_back(params);
+		}
+
+		runComputation(jobs);
+		M.touch();
+    }
+
+    ///
+    /// \brief setSparsityThreshold
+    /// \param threshold Density under which an A block is multiplied with the sparse kernel
+    ///
+    /// 0 always uses the dense kernel. Empty blocks are skipped whatever the threshold.
+    ///
+    void setSparsityThreshold(double threshold)
+    {
+        sparsityThreshold = threshold;
+    }
+
+    ///
+    /// \brief enableOperandCache
+    /// \param budgetBytes Memory for the packed copies of B, 0 disables the cache
+    ///
+    /// Keeps B packed between calls, for a B multiplied by many A. A matrix is
+    /// known by its identifier and version: after modifying the elements of a B
+    /// already multiplied, call B.touch() so that it is packed again.
+    ///
+    void enableOperandCache(std::size_t budgetBytes)
+    {
+        cacheMutex.lock();
+        operandCache.setBudget(budgetBytes);
+        cacheMutex.unlock();
+    }
+
+    ///
+    /// \brief enableResultCache
+    /// \param budgetBytes Memory for the cached products, 0 disables the cache
+    ///
+    /// Keeps the last products, keyed by a 128 bits hash of the contents of A and B,
+    /// which costs a pass over both operands on every call. The least recently used
+    /// products are evicted to stay within the budget.
+    ///
+    void enableResultCache(std::size_t budgetBytes)
+    {
+        cacheMutex.lock();
+        resultCache.setBudget(budgetBytes);
+        cacheMutex.unlock();
+    }
+
+    CacheStatistics getCacheStatistics()
+    {
+        cacheMutex.lock();
+        CacheStatistics copy = statistics;
+        cacheMutex.unlock();
+        return copy;
+    }
+
 protected:
     int nbThreads;
     int nbBlocksPerRow;
+    double sparsityThreshold = 0.25;
 	std::vector<PcoThread*> workerThreads;
-    Buffer<T> buf;
+    Buffer<TIn, TOut> buf;
     PcoMutex resultMutex;
+
+    PcoMutex cacheMutex;
+    LruCache<PackedOperandKey, std::vector<TIn>, PackedOperandKeyHash> operandCache;
+    LruCache<ResultKey, std::vector<TOut>, ResultKeyHash> resultCache;
+    CacheStatistics statistics;
 };
 
 
@@ -1,8 +1,27 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
 #include <gtest/gtest.h>
 #include <pcosynchro/pcotest.h>
 
+#include "distributedmatrixmultiplier.h"
+#include "dotproduct.h"
+#include "freivaldsverifier.h"
+#include "lowprecision.h"
+#include "matrixchain.h"
+#include "mixedprecisiontester.h"
 #include "multipliertester.h"
 #include "multiplierthreadedtester.h"
+#include "referenceproduct.h"
+#include "simplematrixmultiplier.h"
+#include "sparsematrix.h"
 #include "threadedmatrixmultiplier.h"
 
 #define ThreadedMultiplierType ThreadedMatrixMultiplier<int>
@@ -184,6 +203,715 @@ TEST(Multiplier, ExtremeReentrancy)
 #endif // CHECK_DURATION
 }
 
+TEST(Multiplier, ParallelFill)
+{
+#ifdef CHECK_DURATION
+    ASSERT_DURATION_LE(10, ({
+#endif // CHECK_DURATION
+                           constexpr int MATRIXSIZE = 1000;
+                           constexpr int NBTHREADS = 4;
+
+                           // A new matrix is not initialised, the workers first-touch it
+                           SquareMatrix<int> M(MATRIXSIZE);
+                           ThreadedMultiplierType threadedMultiplier(NBTHREADS);
+
+                           threadedMultiplier.fill(M, 42);
+
+                           for (int i = 0; i < MATRIXSIZE; i++) {
+                               for (int j = 0; j < MATRIXSIZE; j++) {
+                                   ASSERT_EQ(M.element(i, j), 42);
+                               }
+                           }
+
+#ifdef CHECK_DURATION
+                       }))
+#endif // CHECK_DURATION
+}
+
+TEST(Matrix, Compare)
+{
+    constexpr int MATRIXSIZE = 600;
+
+    SquareMatrix<int> M1(MATRIXSIZE);
+    SquareMatrix<int> M2(MATRIXSIZE);
+
+    for (int i = 0; i < MATRIXSIZE; i++) {
+        for (int j = 0; j < MATRIXSIZE; j++) {
+            M1.setElement(i, j, i * MATRIXSIZE + j);
+            M2.setElement(i, j, i * MATRIXSIZE + j);
+        }
+    }
+
+    ASSERT_EQ(M1.stride(), static_cast<std::size_t>(MATRIXSIZE));
+    ASSERT_EQ(M1.data()[3 * M1.stride() + 2], M1.element(2, 3));
+    EXPECT_TRUE(M1.compare(M2));
+
+    M2.setElement(MATRIXSIZE - 1, MATRIXSIZE - 1, -1);
+    EXPECT_FALSE(M1.compare(M2));
+
+    M2.setElement(5, 400, -1);
+    EXPECT_FALSE(M1.compare(M2));
+}
+
+TEST(Freivalds, DetectsWrongProduct)
+{
+    constexpr int MATRIXSIZE = 300;
+
+    ReferenceProduct<int> product(MATRIXSIZE);
+
+    FreivaldsVerifier<int> verifier(1e-12);
+    EXPECT_EQ(verifier.getNbRounds(), 40);
+    EXPECT_TRUE(verifier.verify(product.A, product.B, product.C_ref));
+
+    SquareMatrix<int> wrong(product.C_ref);
+    wrong.setElement(17, 123, wrong.element(17, 123) + 1);
+    EXPECT_FALSE(verifier.verify(product.A, product.B, wrong));
+}
+
+TEST(Freivalds, FloatingPointTolerance)
+{
+    constexpr int MATRIXSIZE = 200;
+
+    std::mt19937 rng(42);
+    std::uniform_real_distribution<float> distribution(-1.0f, 1.0f);
+    auto generate = [&](int, int) { return distribution(rng); };
+
+    // rounding differs from the double computation of the verifier
+    ReferenceProduct<float> product(MATRIXSIZE, generate, generate);
+
+    FreivaldsVerifier<float> verifier;
+    EXPECT_TRUE(verifier.verify(product.A, product.B, product.C_ref));
+
+    SquareMatrix<float> wrong(product.C_ref);
+    wrong.setElement(3, 4, wrong.element(3, 4) + 0.01f);
+    EXPECT_FALSE(verifier.verify(product.A, product.B, wrong));
+}
+
+TEST(Freivalds, SelfCheckingMultiplier)
+{
+#ifdef CHECK_DURATION
+    ASSERT_DURATION_LE(30, ({
+#endif // CHECK_DURATION
+                           constexpr int MATRIXSIZE = 1000;
+                           constexpr int NBTHREADS = 4;
+                           constexpr int NBBLOCKSPERROW = 10;
+
+                           // Too large to be checked against SimpleMatrixMultiplier in time
+                           SquareMatrix<int> A(MATRIXSIZE);
+                           SquareMatrix<int> B(MATRIXSIZE);
+                           SquareMatrix<int> C(MATRIXSIZE);
+
+                           for (int i = 0; i < MATRIXSIZE; i++) {
+                               for (int j = 0; j < MATRIXSIZE; j++) {
+                                   A.setElement(i, j, rand());
+                                   B.setElement(i, j, rand());
+                               }
+                           }
+
+                           ThreadedMultiplierType threadedMultiplier(NBTHREADS, NBBLOCKSPERROW);
+                           VerifiedMatrixMultiplier<int> verifiedMultiplier(threadedMultiplier);
+
+                           EXPECT_NO_THROW(verifiedMultiplier.multiply(A, B, C));
+
+#ifdef CHECK_DURATION
+                       }))
+#endif // CHECK_DURATION
+}
+
+TEST(Freivalds, MixedPrecision)
+{
+    constexpr int MATRIXSIZE = 200;
+    constexpr int NBTHREADS = 4;
+    constexpr int NBBLOCKSPERROW = 4;
+
+    SquareMatrix<std::int8_t> A8(MATRIXSIZE);
+    SquareMatrix<std::int8_t> B8(MATRIXSIZE);
+    SquareMatrix<std::int32_t> C32(MATRIXSIZE);
+    SquareMatrix<BFloat16> A16(MATRIXSIZE);
+    SquareMatrix<BFloat16> B16(MATRIXSIZE);
+    SquareMatrix<float> Cf(MATRIXSIZE);
+    SquareMatrix<BFloat16> C16(MATRIXSIZE);
+
+    std::mt19937 rng(3);
+    std::uniform_int_distribution<int> distribution(-128, 127);
+    for (int i = 0; i < MATRIXSIZE; i++) {
+        for (int j = 0; j < MATRIXSIZE; j++) {
+            A8.setElement(i, j, static_cast<std::int8_t>(distribution(rng)));
+            B8.setElement(i, j, static_cast<std::int8_t>(distribution(rng)));
+            A16.setElement(i, j, BFloat16(distribution(rng) / 64.0f));
+            B16.setElement(i, j, BFloat16(distribution(rng) / 64.0f));
+        }
+    }
+
+    EXPECT_GT(FreivaldsVerifier<BFloat16>::defaultTolerance(), 0.0);
+
+    ThreadedMatrixMultiplier<std::int8_t, std::int32_t> int8Multiplier(NBTHREADS, NBBLOCKSPERROW);
+    VerifiedMatrixMultiplier<std::int8_t, std::int32_t> verifiedInt8(int8Multiplier);
+    EXPECT_NO_THROW(verifiedInt8.multiply(A8, B8, C32));
+
+    ThreadedMatrixMultiplier<BFloat16, float> bf16Multiplier(NBTHREADS, NBBLOCKSPERROW);
+    VerifiedMatrixMultiplier<BFloat16, float> verifiedBf16(bf16Multiplier);
+    EXPECT_NO_THROW(verifiedBf16.multiply(A16, B16, Cf));
+
+    // a product rounded to bfloat16 passes with the tolerance of bfloat16
+    ThreadedMatrixMultiplier<BFloat16, float, BFloat16> roundingMultiplier(NBTHREADS, NBBLOCKSPERROW);
+    roundingMultiplier.multiply(A16, B16, C16);
+    FreivaldsVerifier<BFloat16> verifier;
+    EXPECT_TRUE(verifier.verify(A16, B16, C16));
+
+    // but not one off by a few percent, nor a single wrong element
+    SquareMatrix<BFloat16> wrong16(C16);
+    for (int i = 0; i < MATRIXSIZE; i++) {
+        for (int j = 0; j < MATRIXSIZE; j++) {
+            wrong16.setElement(i, j, BFloat16(C16.element(i, j) * 0.96f));
+        }
+    }
+    EXPECT_FALSE(verifier.verify(A16, B16, wrong16));
+    wrong16 = C16;
+    wrong16.setElement(7, 3, BFloat16(C16.element(7, 3) + 64.0f));
+    EXPECT_FALSE(verifier.verify(A16, B16, wrong16));
+
+    SquareMatrix<float> wrongF(Cf);
+    wrongF.setElement(7, 3, Cf.element(7, 3) * 0.99f + 0.01f);
+    FreivaldsVerifier<BFloat16, float> bf16Verifier;
+    EXPECT_FALSE(bf16Verifier.verify(A16, B16, wrongF));
+
+    FreivaldsVerifier<std::int8_t, std::int32_t> int8Verifier;
+    C32.setElement(5, 9, C32.element(5, 9) + 1);
+    EXPECT_FALSE(int8Verifier.verify(A8, B8, C32));
+}
+
+TEST(MixedPrecision, DotProductKernels)
+{
+    std::mt19937 rng(7);
+    std::uniform_int_distribution<int> distribution(-128, 127);
+
+    // lengths around the vector widths, to go through the scalar tails
+    for (std::size_t n : {0, 1, 7, 8, 15, 16, 17, 31, 32, 33, 100, 1000}) {
+        std::vector<std::int8_t> a8(n), b8(n);
+        std::vector<BFloat16> a16(n), b16(n);
+        std::vector<Float16> ah(n), bh(n);
+        for (std::size_t k = 0; k < n; k++) {
+            a8[k] = static_cast<std::int8_t>(distribution(rng));
+            b8[k] = static_cast<std::int8_t>(distribution(rng));
+            a16[k] = BFloat16(a8[k] / 16.0f);
+            b16[k] = BFloat16(b8[k] / 16.0f);
+            ah[k] = Float16(a8[k] / 16.0f);
+            bh[k] = Float16(b8[k] / 16.0f);
+        }
+
+        // all those products and sums are exact in float
+        EXPECT_EQ((dotProduct<std::int32_t>(a8.data(), b8.data(), n)),
+                  (dotProductScalar<std::int32_t>(a8.data(), b8.data(), n)));
+        EXPECT_EQ((dotProduct<float>(a16.data(), b16.data(), n)),
+                  (dotProductScalar<float>(a16.data(), b16.data(), n)));
+        EXPECT_EQ((dotProduct<float>(ah.data(), bh.data(), n)),
+                  (dotProductScalar<float>(ah.data(), bh.data(), n)));
+
+#ifdef MATRIX_X86_DISPATCH
+        // every int8 kernel the CPU has, not only the one picked
+        std::int32_t expected = dotProductScalar<std::int32_t>(a8.data(), b8.data(), n);
+        if (__builtin_cpu_supports("avx512vnni") && __builtin_cpu_supports("avx512vl")) {
+            EXPECT_EQ(dotproduct_detail::dotInt8Avx512Vnni(a8.data(), b8.data(), n), expected);
+        }
+        if (__builtin_cpu_supports("avxvnni")) {
+            EXPECT_EQ(dotproduct_detail::dotInt8AvxVnni(a8.data(), b8.data(), n), expected);
+        }
+        if (__builtin_cpu_supports("avx2")) {
+            EXPECT_EQ(dotproduct_detail::dotInt8Avx2(a8.data(), b8.data(), n), expected);
+        }
+#endif // MATRIX_X86_DISPATCH
+    }
+}
+
+TEST(MixedPrecision, LowPrecisionConversions)
+{
+    EXPECT_EQ(static_cast<float>(BFloat16(1.0f)), 1.0f);
+    EXPECT_EQ(static_cast<float>(BFloat16(-3.0f)), -3.0f);
+    // 1 + 2^-8 is halfway between two bf16, rounds to even
+    EXPECT_EQ(static_cast<float>(BFloat16(1.00390625f)), 1.0f);
+    EXPECT_EQ(static_cast<float>(Float16(1.0f)), 1.0f);
+    EXPECT_EQ(static_cast<float>(Float16(65504.0f)), 65504.0f);
+    EXPECT_TRUE(std::isinf(static_cast<float>(Float16(70000.0f))));
+    // smallest subnormal half
+    EXPECT_EQ(static_cast<float>(Float16(5.9604645e-8f)), 5.9604645e-8f);
+    EXPECT_EQ(static_cast<float>(Float16(0.333251953125f)), 0.333251953125f);
+}
+
+TEST(MixedPrecision, Int8Int32)
+{
+    constexpr int MATRIXSIZE = 200;
+    constexpr int NBTHREADS = 4;
+    constexpr int NBBLOCKSPERROW = 4;
+
+    SimpleMatrixMultiplier<std::int8_t, std::int32_t> multiplier;
+    ThreadedMatrixMultiplier<std::int8_t, std::int32_t> threadedMultiplier(NBTHREADS, NBBLOCKSPERROW);
+
+    // integer products are exact
+    EXPECT_EQ(mixedPrecisionError(multiplier, MATRIXSIZE, 127.0), 0.0);
+    EXPECT_EQ(mixedPrecisionError(threadedMultiplier, MATRIXSIZE, 127.0), 0.0);
+}
+
+TEST(MixedPrecision, BFloat16Float)
+{
+    constexpr int MATRIXSIZE = 200;
+    constexpr int NBTHREADS = 4;
+    constexpr int NBBLOCKSPERROW = 4;
+
+    SimpleMatrixMultiplier<BFloat16, float> multiplier;
+    ThreadedMatrixMultiplier<BFloat16, float> threadedMultiplier(NBTHREADS, NBBLOCKSPERROW);
+
+    // inputs are exact, only the float accumulation rounds
+    EXPECT_LT(mixedPrecisionError(multiplier, MATRIXSIZE, 1.0), 1e-5);
+    EXPECT_LT(mixedPrecisionError(threadedMultiplier, MATRIXSIZE, 1.0), 1e-5);
+
+    // a bf16 output keeps 8 bits of mantissa
+    ThreadedMatrixMultiplier<BFloat16, float, BFloat16> narrowMultiplier(NBTHREADS, 1);
+    EXPECT_LT(mixedPrecisionError(narrowMultiplier, MATRIXSIZE, 1.0), 1e-1);
+}
+
+TEST(MixedPrecision, Float16Float)
+{
+    constexpr int MATRIXSIZE = 200;
+    constexpr int NBTHREADS = 4;
+    constexpr int NBBLOCKSPERROW = 4;
+
+    SimpleMatrixMultiplier<Float16, float> multiplier;
+    ThreadedMatrixMultiplier<Float16, float> threadedMultiplier(NBTHREADS, NBBLOCKSPERROW);
+
+    EXPECT_LT(mixedPrecisionError(multiplier, MATRIXSIZE, 1.0), 1e-5);
+    EXPECT_LT(mixedPrecisionError(threadedMultiplier, MATRIXSIZE, 1.0), 1e-5);
+}
+
+TEST(Sparse, Formats)
+{
+    constexpr int MATRIXSIZE = 120;
+    constexpr int BLOCKSIZE = 20;
+
+    SquareMatrix<int> M(MATRIXSIZE);
+    SquareMatrix<int> dense(MATRIXSIZE);
+
+    // only the diagonal blocks hold elements, one in ten of them non zero
+    for (int i = 0; i < MATRIXSIZE; i++) {
+        for (int j = 0; j < MATRIXSIZE; j++) {
+            bool stored = i / BLOCKSIZE == j / BLOCKSIZE && rand() % 10 == 0;
+            M.setElement(i, j, stored ? 1 + rand() % 100 : 0);
+        }
+    }
+
+    CsrMatrix<int> csr(M);
+    csr.toDense(dense);
+    EXPECT_TRUE(dense.compare(M));
+    EXPECT_LT(csr.density(), 0.05);
+
+    BsrMatrix<int> bsr(M, BLOCKSIZE);
+    EXPECT_EQ(bsr.nbBlocks(), static_cast<std::size_t>(MATRIXSIZE / BLOCKSIZE));
+    bsr.toDense(dense);
+    EXPECT_TRUE(dense.compare(M));
+}
+
+TEST(Sparse, Multiply)
+{
+#ifdef CHECK_DURATION
+    ASSERT_DURATION_LE(30, ({
+#endif // CHECK_DURATION
+                           constexpr int MATRIXSIZE = 300;
+                           constexpr int NBTHREADS = 4;
+                           constexpr int NBBLOCKSPERROW = 10;
+                           constexpr int BLOCKSIZE = MATRIXSIZE / NBBLOCKSPERROW;
+
+                           // 95% zeros, in a third of the blocks the rest is dense
+                           auto generateA = [](int i, int j) {
+                               bool dense = (i / BLOCKSIZE + j / BLOCKSIZE) % 7 == 0;
+                               return dense || rand() % 50 == 0 ? rand() % 100 : 0;
+                           };
+                           auto generateB = [](int i, int j) {
+                               bool dense = ((i / BLOCKSIZE) * (j / BLOCKSIZE)) % 5 == 1;
+                               return dense || rand() % 50 == 0 ? rand() % 100 : 0;
+                           };
+                           ReferenceProduct<int> product(MATRIXSIZE, generateA, generateB);
+                           const SquareMatrix<int>& A = product.A;
+                           const SquareMatrix<int>& B = product.B;
+                           SquareMatrix<int>& C = product.C;
+
+                           ThreadedMultiplierType threadedMultiplier(NBTHREADS, NBBLOCKSPERROW);
+
+                           threadedMultiplier.multiply(A, B, C);
+                           EXPECT_TRUE(product.check());
+
+                           // every non empty block through the sparse kernel
+                           threadedMultiplier.setSparsityThreshold(1.1);
+                           threadedMultiplier.multiply(A, B, C);
+                           EXPECT_TRUE(product.check());
+
+                           // and through the dense one
+                           threadedMultiplier.setSparsityThreshold(0.0);
+                           threadedMultiplier.multiply(A, B, C);
+                           EXPECT_TRUE(product.check());
+
+                           threadedMultiplier.setSparsityThreshold(0.25);
+                           BsrMatrix<int> bsrA(A, BLOCKSIZE);
+                           BsrMatrix<int> bsrB(B, BLOCKSIZE);
+
+                           threadedMultiplier.multiply(bsrA, B, C);
+                           EXPECT_TRUE(product.check());
+
+                           threadedMultiplier.multiply(bsrA, bsrB, C);
+                           EXPECT_TRUE(product.check());
+
+                           CsrMatrix<int> csrA(A);
+                           threadedMultiplier.multiply(csrA, B, C);
+                           EXPECT_TRUE(product.check());
+
+#ifdef CHECK_DURATION
+                       }))
+#endif // CHECK_DURATION
+}
+
+TEST(Sparse, MismatchedSizes)
+{
+    constexpr int MATRIXSIZE = 60;
+    constexpr int NBTHREADS = 4;
+
+    SquareMatrix<int> A(MATRIXSIZE);
+    SquareMatrix<int> B(MATRIXSIZE);
+    SquareMatrix<int> C(MATRIXSIZE);
+    SquareMatrix<int> smallB(MATRIXSIZE / 2);
+    for (int i = 0; i < MATRIXSIZE; i++) {
+        for (int j = 0; j < MATRIXSIZE; j++) {
+            A.setElement(i, j, 1);
+            B.setElement(i, j, 1);
+        }
+    }
+
+    ThreadedMultiplierType threadedMultiplier(NBTHREADS);
+
+    // blocks of 20 against blocks of 30
+    BsrMatrix<int> bsrA(A, 20);
+    BsrMatrix<int> bsrB(B, 30);
+    EXPECT_THROW(threadedMultiplier.multiply(bsrA, bsrB, C), std::invalid_argument);
+
+    EXPECT_THROW(threadedMultiplier.multiply(bsrA, smallB, C), std::invalid_argument);
+    EXPECT_THROW(threadedMultiplier.multiply(bsrA, B, smallB), std::invalid_argument);
+
+    CsrMatrix<int> csrA(A);
+    EXPECT_THROW(threadedMultiplier.multiply(csrA, smallB, C), std::invalid_argument);
+
+    // the multiplier is still usable
+    threadedMultiplier.multiply(bsrA, B, C);
+    EXPECT_EQ(C.element(7, 11), MATRIXSIZE);
+}
+
+TEST(MatrixChain, OptimalOrder)
+{
+    // classic example: 30x35, 35x15, 15x5, 5x10, 10x20, 20x25
+    std::vector<std::unique_ptr<Matrix<int>>> matrices;
+    std::size_t dimensions[] = {30, 35, 15, 5, 10, 20, 25};
+    for (int i = 0; i < 6; i++) {
+        matrices.push_back(std::make_unique<Matrix<int>>(dimensions[i + 1], dimensions[i]));
+    }
+
+    auto product = chain(*matrices[0]) * *matrices[1] * *matrices[2] * *matrices[3] * *matrices[4] * *matrices[5];
+    EXPECT_EQ(product.optimalCost(), 15125u);
+    EXPECT_EQ(product.getSizeY(), 30u);
+    EXPECT_EQ(product.getSizeX(), 25u);
+
+    EXPECT_THROW(chain(*matrices[0]) * *matrices[2], std::invalid_argument);
+}
+
+TEST(MatrixChain, Evaluate)
+{
+#ifdef CHECK_DURATION
+    ASSERT_DURATION_LE(30, ({
+#endif // CHECK_DURATION
+                           constexpr int NBTHREADS = 4;
+
+                           // 150x40 * 40x200 * 200x10 * 10x120
+                           Matrix<int> A(40, 150);
+                           Matrix<int> B(200, 40);
+                           Matrix<int> C(10, 200);
+                           Matrix<int> D(120, 10);
+                           for (Matrix<int>* M : {&A, &B, &C, &D}) {
+                               for (std::size_t y = 0; y < M->getSizeY(); y++) {
+                                   for (std::size_t x = 0; x < M->getSizeX(); x++) {
+                                       M->setElement(x, y, rand() % 10 - 5);
+                                   }
+                               }
+                           }
+
+                           // reference, left to right
+                           auto naiveProduct = [](const Matrix<int>& L, const Matrix<int>& R) {
+                               Matrix<int> P(R.getSizeX(), L.getSizeY());
+                               for (std::size_t y = 0; y < P.getSizeY(); y++) {
+                                   for (std::size_t x = 0; x < P.getSizeX(); x++) {
+                                       int sum = 0;
+                                       for (std::size_t k = 0; k < L.getSizeX(); k++) {
+                                           sum += L.element(k, y) * R.element(x, k);
+                                       }
+                                       P.setElement(x, y, sum);
+                                   }
+                               }
+                               return P;
+                           };
+                           Matrix<int> reference = naiveProduct(naiveProduct(naiveProduct(A, B), C), D);
+
+                           ThreadedMultiplierType threadedMultiplier(NBTHREADS);
+                           Matrix<int> result(120, 150);
+
+                           // tiles not dividing the sizes, and a single tile per product
+                           for (std::size_t tileSize : {16, 64, 512}) {
+                               auto product = chain(A) * B * C * D;
+                               product.evaluate(threadedMultiplier, result, tileSize);
+                               EXPECT_TRUE(result.compare(reference));
+                           }
+
+                           Matrix<int> copy(40, 150);
+                           chain(A).evaluate(threadedMultiplier, copy);
+                           EXPECT_TRUE(copy.compare(A));
+
+                           // tiles would read what others are overwriting
+                           Matrix<int> square(150, 150);
+                           EXPECT_THROW(chain(square).evaluate(threadedMultiplier, square), std::invalid_argument);
+                           EXPECT_THROW((chain(square) * square).evaluate(threadedMultiplier, square), std::invalid_argument);
+
+#ifdef CHECK_DURATION
+                       }))
+#endif // CHECK_DURATION
+}
+
+TEST(Cache, PackedOperand)
+{
+    constexpr int MATRIXSIZE = 200;
+    constexpr int NBTHREADS = 4;
+    constexpr int NBBLOCKSPERROW = 4;
+
+    ReferenceProduct<int> product(MATRIXSIZE);
+
+    ThreadedMultiplierType threadedMultiplier(NBTHREADS, NBBLOCKSPERROW);
+    threadedMultiplier.enableOperandCache(16 * 1024 * 1024);
+
+    // the same B against several A: packed once
+    threadedMultiplier.multiply(product.A, product.B, product.C);
+    EXPECT_TRUE(product.check());
+
+    product.randomize(product.A);
+    product.update();
+    threadedMultiplier.multiply(product.A, product.B, product.C);
+    EXPECT_TRUE(product.check());
+
+    EXPECT_EQ(threadedMultiplier.getCacheStatistics().operandMisses, 1u);
+    EXPECT_EQ(threadedMultiplier.getCacheStatistics().operandHits, 1u);
+
+    // a modified B is packed again once touched
+    product.B.setElement(3, 7, 42);
+    product.B.touch();
+    product.update();
+    threadedMultiplier.multiply(product.A, product.B, product.C);
+    EXPECT_TRUE(product.check());
+
+    EXPECT_EQ(threadedMultiplier.getCacheStatistics().operandMisses, 2u);
+    EXPECT_EQ(threadedMultiplier.getCacheStatistics().operandHits, 1u);
+}
+
+TEST(Cache, OperandWrittenByMultiplier)
+{
+    constexpr int MATRIXSIZE = 120;
+    constexpr int NBTHREADS = 4;
+    constexpr int NBBLOCKSPERROW = 4;
+
+    ReferenceProduct<int> product(MATRIXSIZE);
+    SquareMatrix<int> X(MATRIXSIZE);
+    SquareMatrix<int> Y(MATRIXSIZE);
+    ReferenceProduct<int>::randomize(X);
+    ReferenceProduct<int>::randomize(Y);
+
+    ThreadedMultiplierType threadedMultiplier(NBTHREADS, NBBLOCKSPERROW);
+    threadedMultiplier.enableOperandCache(16 * 1024 * 1024);
+
+    threadedMultiplier.multiply(product.A, product.B, product.C);
+    EXPECT_TRUE(product.check());
+
+    // B rewritten by the multiplier itself, through every path, between two cached uses
+    (chain(X) * Y).evaluate(threadedMultiplier, product.B);
+    product.update();
+    threadedMultiplier.multiply(product.A, product.B, product.C);
+    EXPECT_TRUE(product.check());
+
+    chain(X).evaluate(threadedMultiplier, product.B);
+    product.update();
+    threadedMultiplier.multiply(product.A, product.B, product.C);
+    EXPECT_TRUE(product.check());
+
+    threadedMultiplier.multiply(Y, X, product.B);
+    product.update();
+    threadedMultiplier.multiply(product.A, product.B, product.C);
+    EXPECT_TRUE(product.check());
+
+    threadedMultiplier.multiply(CsrMatrix<int>(X), Y, product.B);
+    product.update();
+    threadedMultiplier.multiply(product.A, product.B, product.C);
+    EXPECT_TRUE(product.check());
+
+    threadedMultiplier.fill(product.B, 3);
+    product.update();
+    threadedMultiplier.multiply(product.A, product.B, product.C);
+    EXPECT_TRUE(product.check());
+
+    EXPECT_EQ(threadedMultiplier.getCacheStatistics().operandHits, 0u);
+}
+
+TEST(Cache, Result)
+{
+    constexpr int MATRIXSIZE = 200;
+    constexpr int NBTHREADS = 4;
+    constexpr int NBBLOCKSPERROW = 4;
+
+    ReferenceProduct<int> product(MATRIXSIZE);
+    const SquareMatrix<int>& A = product.A;
+    const SquareMatrix<int>& B = product.B;
+    SquareMatrix<int>& C = product.C;
+
+    // room for a single result
+    ThreadedMultiplierType threadedMultiplier(NBTHREADS, NBBLOCKSPERROW);
+    threadedMultiplier.enableResultCache(MATRIXSIZE * MATRIXSIZE * sizeof(int));
+
+    threadedMultiplier.multiply(A, B, C);
+    EXPECT_TRUE(product.check());
+
+    // same contents in other matrices: hit
+    SquareMatrix<int> copyA(A);
+    SquareMatrix<int> other(MATRIXSIZE);
+    threadedMultiplier.fill(other, 0);
+    threadedMultiplier.fill(C, 0);
+    threadedMultiplier.multiply(copyA, B, C);
+    EXPECT_TRUE(product.check());
+    EXPECT_EQ(threadedMultiplier.getCacheStatistics().resultHits, 1u);
+    EXPECT_EQ(threadedMultiplier.getCacheStatistics().resultMisses, 1u);
+
+    // another product evicts the first one
+    threadedMultiplier.multiply(other, B, C);
+    threadedMultiplier.multiply(A, B, C);
+    EXPECT_TRUE(product.check());
+    EXPECT_EQ(threadedMultiplier.getCacheStatistics().resultHits, 1u);
+    EXPECT_EQ(threadedMultiplier.getCacheStatistics().resultMisses, 3u);
+}
+
+TEST(Distributed, Summa)
+{
+    constexpr int MATRIXSIZE = 120;
+    constexpr int NBTHREADSPERPROCESS = 2;
+
+    // 1, 4 and 9 local processes, whose helpers are forked before the duration check starts a thread
+    std::vector<std::unique_ptr<DistributedMatrixMultiplier<int>>> multipliers;
+    for (int gridSize : {1, 2, 3}) {
+        multipliers.push_back(std::make_unique<DistributedMatrixMultiplier<int>>(gridSize, NBTHREADSPERPROCESS));
+    }
+    DistributedMatrixMultiplier<int> notDividing(7);
+
+#ifdef CHECK_DURATION
+    ASSERT_DURATION_LE(30, ({
+#endif // CHECK_DURATION
+                           ReferenceProduct<int> product(MATRIXSIZE);
+
+                           for (auto& distributedMultiplier : multipliers) {
+                               distributedMultiplier->multiply(product.A, product.B, product.C);
+                               EXPECT_TRUE(product.check());
+                           }
+
+                           // blocks of a prime size, padded by the workers
+                           ReferenceProduct<int> primeBlocks(2 * 131);
+                           multipliers[1]->multiply(primeBlocks.A, primeBlocks.B, primeBlocks.C);
+                           EXPECT_TRUE(primeBlocks.check());
+
+                           EXPECT_THROW(notDividing.multiply(product.A, product.B, product.C), std::invalid_argument);
+
+#ifdef CHECK_DURATION
+                       }))
+#endif // CHECK_DURATION
+}
+
+// Run with --gtest_also_run_disabled_tests, takes minutes
+TEST(Distributed, DISABLED_BenchmarkScaling)
+{
+    constexpr int MATRIXSIZE = 1680;
+
+    using Clock = std::chrono::steady_clock;
+
+    SquareMatrix<float> A(MATRIXSIZE);
+    SquareMatrix<float> B(MATRIXSIZE);
+    SquareMatrix<float> C(MATRIXSIZE);
+    for (int i = 0; i < MATRIXSIZE; i++) {
+        for (int j = 0; j < MATRIXSIZE; j++) {
+            A.setElement(i, j, static_cast<float>(rand() % 16));
+            B.setElement(i, j, static_cast<float>(rand() % 16));
+        }
+    }
+
+    // efficiency: time with one process over (cores used x time with them). Each process
+    // computes on a single thread, its communication thread waiting on the sockets, so a
+    // grid of more processes than cores shares those cores and is measured against them.
+    int nbCores = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    double singleProcessMs = 0.0;
+    for (int gridSize : {1, 2, 3, 4}) {
+        DistributedMatrixMultiplier<float> distributedMultiplier(gridSize, 1);
+        auto start = Clock::now();
+        distributedMultiplier.multiply(A, B, C);
+        double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+        if (gridSize == 1) {
+            singleProcessMs = ms;
+        }
+        int nbProcesses = distributedMultiplier.getNbProcesses();
+        int nbCoresUsed = std::min(nbProcesses, nbCores);
+        std::cout << nbProcesses << " processes on " << nbCoresUsed << " cores: " << ms << " ms, efficiency "
+                  << singleProcessMs / (nbCoresUsed * ms) << std::endl;
+    }
+}
+
+// Run with --gtest_also_run_disabled_tests, takes minutes
+TEST(Multiplier, DISABLED_BenchmarkConstructFillMultiply)
+{
+    constexpr int MATRIXSIZE = 4096;
+    constexpr int NBTHREADS = 8;
+    constexpr int NBBLOCKSPERROW = 16;
+
+    using Clock = std::chrono::steady_clock;
+    auto elapsedMs = [](Clock::time_point start) {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(Clock::now() - start).count();
+    };
+
+    // Reference: value-initialised std::vector storage, zeroed then filled serially
+    auto start = Clock::now();
+    {
+        SquareMatrix<int, std::allocator<int>> M(MATRIXSIZE);
+        for (int i = 0; i < MATRIXSIZE; i++) {
+            for (int j = 0; j < MATRIXSIZE; j++) {
+                M.setElement(i, j, 1);
+            }
+        }
+    }
+    std::cout << "std::allocator construct+fill: " << elapsedMs(start) << " ms" << std::endl;
+
+    ThreadedMultiplierType threadedMultiplier(NBTHREADS, NBBLOCKSPERROW);
+
+    start = Clock::now();
+    SquareMatrix<int> A(MATRIXSIZE);
+    SquareMatrix<int> B(MATRIXSIZE);
+    SquareMatrix<int> C(MATRIXSIZE);
+    std::cout << "MatrixAllocator construct: " << elapsedMs(start) << " ms" << std::endl;
+
+    start = Clock::now();
+    threadedMultiplier.fill(A, 1);
+    threadedMultiplier.fill(B, 2);
+    std::cout << "MatrixAllocator parallel fill: " << elapsedMs(start) << " ms" << std::endl;
+
+    start = Clock::now();
+    threadedMultiplier.multiply(A, B, C);
+    std::cout << "Multiply: " << elapsedMs(start) << " ms" << std::endl;
+
+    EXPECT_EQ(C.element(0, 0), 2 * MATRIXSIZE);
+    EXPECT_EQ(C.element(MATRIXSIZE - 1, MATRIXSIZE - 1), 2 * MATRIXSIZE);
+}
+
 
 int main(int argc, char** argv)
 {
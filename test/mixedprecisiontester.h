@@ -0,0 +1,54 @@
+#ifndef MIXEDPRECISIONTESTER_H
+#define MIXEDPRECISIONTESTER_H
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include "abstractmatrixmultiplier.h"
+#include "matrix.h"
+
+
+/**
+ * Checks the accuracy of a mixed precision multiplier against a reference
+ * computed in double from the same (already narrowed) inputs.
+ * Returns the largest error, relative to the norm of the terms of each element.
+ */
+template<class TIn, class TAcc, class TOut>
+double mixedPrecisionError(AbstractMatrixMultiplier<TIn, TAcc, TOut>& multiplier, int matrixSize, double range)
+{
+    SquareMatrix<TIn> A(matrixSize);
+    SquareMatrix<TIn> B(matrixSize);
+    SquareMatrix<TOut> C(matrixSize);
+
+    std::mt19937 rng(matrixSize);
+    std::uniform_real_distribution<double> distribution(-range, range);
+    for (int i = 0; i < matrixSize; i++) {
+        for (int j = 0; j < matrixSize; j++) {
+            A.setElement(i, j, static_cast<TIn>(distribution(rng)));
+            B.setElement(i, j, static_cast<TIn>(distribution(rng)));
+        }
+    }
+
+    multiplier.multiply(A, B, C);
+
+    double maxError = 0.0;
+    for (int j = 0; j < matrixSize; j++) {
+        for (int i = 0; i < matrixSize; i++) {
+            double reference = 0.0;
+            double norm = 0.0;
+            for (int k = 0; k < matrixSize; k++) {
+                double term = static_cast<double>(A.element(k, j)) * static_cast<double>(B.element(i, k));
+                reference += term;
+                norm += term * term;
+            }
+            double error = std::abs(static_cast<double>(C.element(i, j)) - reference);
+            if (error > 0.0) {
+                maxError = std::max(maxError, error / std::sqrt(norm));
+            }
+        }
+    }
+    return maxError;
+}
+
+#endif // MIXEDPRECISIONTESTER_H
@@ -0,0 +1,71 @@
+#ifndef REFERENCEPRODUCT_H
+#define REFERENCEPRODUCT_H
+
+#include <cstdlib>
+
+#include "matrix.h"
+#include "simplematrixmultiplier.h"
+
+
+/**
+ * Operands of a test and their product computed by SimpleMatrixMultiplier, to
+ * check the results of the other multipliers: C is left for the multiplier under
+ * test and check() compares it with C_ref.
+ * After modifying A or B, update() computes C_ref again.
+ */
+template<class T>
+struct ReferenceProduct
+{
+    //! Operands filled with rand()
+    explicit ReferenceProduct(int matrixSize)
+        : ReferenceProduct(matrixSize, randomElement, randomElement)
+    {
+    }
+
+    //! Element (i, j) of A is generateA(i, j), and likewise for B
+    template<class GenerateA, class GenerateB>
+    ReferenceProduct(int matrixSize, GenerateA generateA, GenerateB generateB)
+        : A(matrixSize), B(matrixSize), C(matrixSize), C_ref(matrixSize)
+    {
+        for (int i = 0; i < matrixSize; i++) {
+            for (int j = 0; j < matrixSize; j++) {
+                A.setElement(i, j, generateA(i, j));
+                B.setElement(i, j, generateB(i, j));
+            }
+        }
+        update();
+    }
+
+    void update()
+    {
+        SimpleMatrixMultiplier<T> multiplier;
+        multiplier.multiply(A, B, C_ref);
+    }
+
+    bool check() const
+    {
+        return C.compare(C_ref);
+    }
+
+    static T randomElement(int, int)
+    {
+        return static_cast<T>(rand());
+    }
+
+    //! Fills M with rand()
+    static void randomize(SquareMatrix<T>& M)
+    {
+        for (std::size_t i = 0; i < M.size(); i++) {
+            for (std::size_t j = 0; j < M.size(); j++) {
+                M.setElement(i, j, randomElement(0, 0));
+            }
+        }
+    }
+
+    SquareMatrix<T> A;
+    SquareMatrix<T> B;
+    SquareMatrix<T> C;
+    SquareMatrix<T> C_ref;
+};
+
+#endif // REFERENCEPRODUCT_H